@@ -0,0 +1,608 @@
+// SPDX-License-Identifier: LicenseRef-Dual-LGPLv3-OR-CC-BY-ND-For-Rust
+/* Times libcda stage by stage on the pages of a corpus, then end to end
+ * against bench/server serving that corpus. The stages are reached through
+ * get_url_internal.h, so it links against src/get_url.o as built. */
+#define _GNU_SOURCE
+#include <dirent.h>
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/wait.h>
+
+#include "libcda.h"
+#include "../src/get_url_internal.h"
+
+struct bench_page {
+	char * name;
+	char * video_id;
+	char * html;
+	size_t size;
+	struct player_data_scanner scanner;
+	char * raw_json;
+	char * file;
+};
+
+struct bench_options {
+	const char * corpus;
+	const char * server;
+	long latency;
+	size_t iterations;
+	size_t resolves;
+	size_t concurrency;
+	size_t threads;
+	size_t scaling_threads;
+	long drain_limit;
+};
+
+static struct bench_page * pages = NULL;
+static size_t page_count = 0;
+
+static uint64_t bench_clock(void) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+static int compare_samples(const void * a, const void * b) {
+	const uint64_t x = *(const uint64_t *)a;
+	const uint64_t y = *(const uint64_t *)b;
+	return (x > y) - (x < y);
+}
+
+/* samples are nanoseconds, printed in multiples of unit */
+static void print_percentiles(const char * name, uint64_t * samples, const size_t count, const double unit) {
+	qsort(samples, count, sizeof(uint64_t), compare_samples);
+	printf("%-32s %10.1f %10.1f %10.1f %10.1f\n", name, samples[count / 2] / unit, samples[count * 9 / 10] / unit, samples[count * 99 / 100] / unit, samples[count - 1] / unit);
+}
+
+static int load_page(const char * directory, const char * file_name) {
+	struct bench_page * page = NULL;
+	struct bench_page * bigger = NULL;
+	struct known_size_memory_region whole_page;
+	struct player_data video;
+	char path[4096];
+	char * player_id = NULL;
+	FILE * file = NULL;
+	size_t name_length = strlen(file_name) - 5;
+	long size = 0;
+
+	snprintf(path, sizeof(path), "%s/%s", directory, file_name);
+	file = fopen(path, "rb");
+	if(file == NULL) return 1;
+	bigger = realloc(pages, (page_count + 1) * sizeof(struct bench_page));
+	if(bigger == NULL) {
+		fclose(file);
+		return 1;
+	}
+	pages = bigger;
+	page = memset(pages + page_count, 0, sizeof(struct bench_page));
+	fseek(file, 0, SEEK_END);
+	size = ftell(file);
+	rewind(file);
+	page->html = malloc(size + 1);
+	if(page->html == NULL || fread(page->html, 1, size, file) != (size_t)size) {
+		fclose(file);
+		free(page->html);
+		return 1;
+	}
+	fclose(file);
+	page->html[size] = '\0';
+	page->size = size;
+	page->name = strndup(file_name, name_length);
+	page->video_id = strndup(file_name, strcspn(file_name, "_."));
+
+	player_id = get_player_id(page->video_id);
+	page->scanner.needle = player_id;
+	page->scanner.needle_length = strlen(player_id);
+	whole_page.memory = page->html;
+	whole_page.size = page->size;
+	if(!scan_for_player_data(&(page->scanner), &whole_page) || parse_player_data(&video, page->video_id, &whole_page, &(page->scanner), LIBCDA_JSON_PARSER_LAZY, NULL)) {
+		fprintf(stderr, "load_page: %s has no usable player_data.\n", path);
+		return 1;
+	}
+	page->raw_json = strdup(video.raw_json);
+	if(video.file.length) page->file = json_slice_dup(&(video.file));
+	free_player_data(&video);
+	++page_count;
+	return 0;
+}
+
+static int load_corpus(const char * directory) {
+	DIR * listing = opendir(directory);
+	struct dirent * entry = NULL;
+	size_t name_length = 0;
+	int bad = 0;
+	if(listing == NULL) {
+		fprintf(stderr, "load_corpus: could not open %s: %s\n", directory, strerror(errno));
+		return 1;
+	}
+	while((entry = readdir(listing)) != NULL && !bad) {
+		name_length = strlen(entry->d_name);
+		if(name_length > 5 && !strcmp(entry->d_name + name_length - 5, ".html")) bad = load_page(directory, entry->d_name);
+	}
+	closedir(listing);
+	if(!page_count) fprintf(stderr, "load_corpus: no pages in %s.\n", directory);
+	return bad || !page_count;
+}
+
+/* Every stage runs once per sample on one page, going round the corpus. */
+static void stage_scan(struct bench_page * page) {
+	struct player_data_scanner scanner = {0};
+	struct known_size_memory_region whole_page = {page->html, page->size};
+	scanner.needle = page->scanner.needle;
+	scanner.needle_length = page->scanner.needle_length;
+	scan_for_player_data(&scanner, &whole_page);
+}
+
+static void stage_extract_fast(struct bench_page * page) {
+	free(extract_raw_json_fast(page->html, &(page->scanner)));
+}
+
+static void stage_extract_libxml2(struct bench_page * page) {
+	free(extract_raw_json_with_libxml2(page->video_id, page->html, page->size));
+}
+
+static void stage_json_lazy(struct bench_page * page) {
+	struct player_data video = {0};
+	video.raw_json = page->raw_json;
+	video.raw_json_length = strlen(page->raw_json);
+	read_player_data_lazily(&video);
+	video.raw_json = NULL;
+	free_player_data(&video);
+}
+
+static void stage_json_c(struct bench_page * page) {
+	struct player_data video = {0};
+	video.raw_json = page->raw_json;
+	video.raw_json_length = strlen(page->raw_json);
+	read_player_data_with_json_c(&video);
+	video.raw_json = NULL;
+	free_player_data(&video);
+}
+
+static void stage_decode_url(struct bench_page * page) {
+	struct results_draft draft = {0};
+	decode_url(page->file, strlen(page->file), &draft);
+	free_results_draft(&draft);
+}
+
+static void stage_decode_url_in_stages(struct bench_page * page) {
+	free(decode_url_in_stages(page->file, strlen(page->file)));
+}
+
+static void time_stage(const char * name, void (*stage)(struct bench_page *), const int needs_file, const size_t iterations) {
+	uint64_t * samples = malloc(iterations * sizeof(uint64_t));
+	uint64_t start = 0;
+	size_t counter = 0;
+	size_t page = 0;
+	if(samples == NULL) return;
+	for(counter = 0; counter < iterations; ++counter) {
+		do page = (page + 1) % page_count; while(needs_file && pages[page].file == NULL);
+		start = bench_clock();
+		stage(pages + page);
+		samples[counter] = bench_clock() - start;
+	}
+	print_percentiles(name, samples, iterations, 1);
+	free(samples);
+}
+
+/* Kernels take well under a microsecond, so a sample is the average of a
+ * batch of calls on the file string of a page. */
+#define KERNEL_BATCH 64
+
+static void time_kernels(const size_t iterations) {
+	uint64_t * samples = malloc(iterations * sizeof(uint64_t));
+	char * buffer = aligned_alloc(LIBCDA_SIMD_ALIGNMENT, 4096);
+	char name[64];
+	uint64_t start = 0;
+	size_t consumed = 0;
+	size_t length = 0;
+	size_t kernel = 0;
+	size_t counter = 0;
+	size_t batch = 0;
+	size_t page = 0;
+	if(samples == NULL || buffer == NULL) {
+		free(samples);
+		free(buffer);
+		return;
+	}
+	for(kernel = 0; kernel < kernel_table_size; ++kernel) {
+		if(!cpu_supports_kernel(kernel_table + kernel)) continue;
+		for(counter = 0; counter < iterations; ++counter) {
+			do page = (page + 1) % page_count; while(pages[page].file == NULL);
+			length = strlen(pages[page].file);
+			memcpy(buffer, pages[page].file, length);
+			start = bench_clock();
+			for(batch = 0; batch < KERNEL_BATCH; ++batch) kernel_table[kernel].weird_decoding_ritual(buffer, length);
+			samples[counter] = (bench_clock() - start) / KERNEL_BATCH;
+		}
+		snprintf(name, sizeof(name), "weird_decoding_ritual %s", kernel_table[kernel].name);
+		print_percentiles(name, samples, iterations, 1);
+		for(counter = 0; counter < iterations; ++counter) {
+			do page = (page + 1) % page_count; while(pages[page].file == NULL);
+			length = strlen(pages[page].file);
+			start = bench_clock();
+			for(batch = 0; batch < KERNEL_BATCH; ++batch) kernel_table[kernel].unquote(buffer, pages[page].file, length, &consumed);
+			samples[counter] = (bench_clock() - start) / KERNEL_BATCH;
+		}
+		snprintf(name, sizeof(name), "unquote %s", kernel_table[kernel].name);
+		print_percentiles(name, samples, iterations, 1);
+	}
+	free(buffer);
+	free(samples);
+}
+
+/* Every thread runs what a resolve does with a page, from the scan to the
+ * decoded URL, or only the libxml2 extraction, over its own round of the
+ * corpus. With nothing shared between them, pages/s should grow with the
+ * threads up to the number of cores. */
+struct scaling_worker {
+	pthread_barrier_t * start;
+	size_t iterations;
+	int libxml2;
+};
+
+static void * run_pipeline(void * argument) {
+	struct scaling_worker * worker = argument;
+	struct bench_page * page = NULL;
+	struct known_size_memory_region whole_page;
+	struct results_draft draft;
+	struct player_data video;
+	size_t counter = 0;
+	pthread_barrier_wait(worker->start);
+	for(counter = 0; counter < worker->iterations; ++counter) {
+		page = pages + counter % page_count;
+		if(worker->libxml2) {
+			free(extract_raw_json_with_libxml2(page->video_id, page->html, page->size));
+			continue;
+		}
+		whole_page.memory = page->html;
+		whole_page.size = page->size;
+		if(parse_player_data(&video, page->video_id, &whole_page, NULL, LIBCDA_JSON_PARSER_LAZY, NULL)) continue;
+		memset(&draft, 0, sizeof(draft));
+		if(video.file.length) get_url_from_json(&video, &draft);
+		free_results_draft(&draft);
+		free_player_data(&video);
+	}
+	return NULL;
+}
+
+static double pages_per_second(const size_t thread_count, const size_t iterations, const int libxml2) {
+	struct scaling_worker * workers = calloc(thread_count, sizeof(struct scaling_worker));
+	pthread_t * threads = calloc(thread_count, sizeof(pthread_t));
+	pthread_barrier_t start;
+	uint64_t started = 0;
+	size_t counter = 0;
+	if(workers == NULL || threads == NULL) {
+		free(workers);
+		free(threads);
+		return 0;
+	}
+	pthread_barrier_init(&start, NULL, thread_count + 1);
+	for(counter = 0; counter < thread_count; ++counter) {
+		workers[counter].start = &start;
+		workers[counter].iterations = iterations;
+		workers[counter].libxml2 = libxml2;
+		pthread_create(threads + counter, NULL, run_pipeline, workers + counter);
+	}
+	pthread_barrier_wait(&start);
+	started = bench_clock();
+	for(counter = 0; counter < thread_count; ++counter) pthread_join(threads[counter], NULL);
+	started = bench_clock() - started;
+	pthread_barrier_destroy(&start);
+	free(threads);
+	free(workers);
+	return thread_count * iterations / (started / 1e9);
+}
+
+static void time_scaling(const size_t iterations, const size_t max_threads) {
+	double pipeline_base = 0;
+	double libxml2_base = 0;
+	double pipeline = 0;
+	double libxml2 = 0;
+	size_t thread_count = 1;
+	printf("\n%-10s %12s %8s %12s %8s\n", "threads", "pipeline/s", "speedup", "libxml2/s", "speedup");
+	for(;;) {
+		pipeline = pages_per_second(thread_count, iterations * 10, 0);
+		libxml2 = pages_per_second(thread_count, iterations / 50 + 1, 1);
+		if(thread_count == 1) {
+			pipeline_base = pipeline;
+			libxml2_base = libxml2;
+		}
+		printf("%-10zu %12.0f %8.2f %12.0f %8.2f\n", thread_count, pipeline, pipeline / pipeline_base, libxml2, libxml2 / libxml2_base);
+		if(thread_count >= max_threads) break;
+		thread_count = thread_count << 1 < max_threads ? thread_count << 1 : max_threads;
+	}
+}
+
+/* Starts the server on a free port and returns that port */
+static int start_server(const struct bench_options * options, pid_t * server) {
+	char latency[32];
+	char line[32];
+	int output[2];
+	ssize_t got = 0;
+	snprintf(latency, sizeof(latency), "%ld", options->latency);
+	if(pipe(output)) return -1;
+	*server = fork();
+	if(*server < 0) return -1;
+	if(!*server) {
+		dup2(output[1], STDOUT_FILENO);
+		close(output[0]);
+		close(output[1]);
+		execl(options->server, options->server, "-d", options->corpus, "-p", "0", "-l", latency, (char *)NULL);
+		fprintf(stderr, "start_server: could not run %s: %s\n", options->server, strerror(errno));
+		_exit(1);
+	}
+	close(output[1]);
+	got = read(output[0], line, sizeof(line) - 1);
+	close(output[0]);
+	if(got <= 0) return -1;
+	line[got] = '\0';
+	return atoi(line);
+}
+
+struct resolve_worker {
+	char ** urls;
+	size_t count;
+	long drain_limit;
+	size_t failures;
+};
+
+/* A negative limit keeps the one libcda picks */
+static struct libcda_session * create_session(const long drain_limit) {
+	struct libcda_session * session = libcda_session_create();
+	if(session != NULL && drain_limit >= 0) libcda_session_setopt(session, LIBCDA_OPT_DRAIN_LIMIT, drain_limit);
+	return session;
+}
+
+static void * resolve_sequentially(void * argument) {
+	struct resolve_worker * worker = argument;
+	struct libcda_session * session = create_session(worker->drain_limit);
+	struct cda_results * result = NULL;
+	size_t counter = 0;
+	for(counter = 0; counter < worker->count; ++counter) {
+		result = session != NULL ? libcda_session_get_url(session, worker->urls[counter]) : NULL;
+		worker->failures += result == NULL;
+		libcda_free_get_url(result);
+	}
+	libcda_session_destroy(session);
+	return NULL;
+}
+
+/* One thread, one epoll set, every resolve at once */
+struct async_loop {
+	int epoll;
+	long timeout;
+	size_t done;
+	size_t failures;
+};
+
+static void watch_socket(const int fd, const int events, void * userdata) {
+	struct async_loop * loop = userdata;
+	struct epoll_event watched = {0};
+	watched.data.fd = fd;
+	watched.events = (events & LIBCDA_POLL_IN ? EPOLLIN : 0) | (events & LIBCDA_POLL_OUT ? EPOLLOUT : 0);
+	if(events == LIBCDA_POLL_REMOVE) epoll_ctl(loop->epoll, EPOLL_CTL_DEL, fd, NULL);
+	else if(epoll_ctl(loop->epoll, EPOLL_CTL_MOD, fd, &watched) && errno == ENOENT) epoll_ctl(loop->epoll, EPOLL_CTL_ADD, fd, &watched);
+}
+
+static void set_timer(const long timeout, void * userdata) {
+	((struct async_loop *)userdata)->timeout = timeout;
+}
+
+static void count_result(struct cda_results * result, const int status, const struct libcda_stats * stats, void * userdata) {
+	struct async_loop * loop = userdata;
+	(void)status;
+	(void)stats;
+	++loop->done;
+	loop->failures += result == NULL;
+	libcda_free_get_url(result);
+}
+
+static size_t resolve_with_epoll(struct libcda_session * session, char ** urls, const size_t count, const size_t concurrency) {
+	struct async_loop loop = {-1, -1, 0, 0};
+	struct epoll_event events[64];
+	struct libcda_async * async = NULL;
+	size_t counter = 0;
+	int ready = 0;
+	int event = 0;
+	loop.epoll = epoll_create1(0);
+	async = loop.epoll >= 0 ? libcda_async_create(session, concurrency, watch_socket, set_timer, &loop) : NULL;
+	if(async == NULL) {
+		if(loop.epoll >= 0) close(loop.epoll);
+		return count;
+	}
+	for(counter = 0; counter < count; ++counter) {
+		if(libcda_async_get_url(async, urls[counter], count_result, &loop)) {
+			++loop.done;
+			++loop.failures;
+		}
+	}
+	while(loop.done < count) {
+		ready = epoll_wait(loop.epoll, events, 64, loop.timeout < 0 ? 1000 : loop.timeout);
+		if(ready <= 0) libcda_async_perform(async, LIBCDA_SOCKET_TIMEOUT, 0);
+		for(event = 0; event < ready; ++event) {
+			libcda_async_perform(async, events[event].data.fd, (events[event].events & EPOLLIN ? LIBCDA_POLL_IN : 0) | (events[event].events & EPOLLOUT ? LIBCDA_POLL_OUT : 0));
+		}
+	}
+	libcda_async_destroy(async);
+	close(loop.epoll);
+	return loop.failures;
+}
+
+static void resolve_all_ways(const struct bench_options * options, char ** urls) {
+	struct libcda_session * session = create_session(options->drain_limit);
+	struct cda_results ** results = NULL;
+	struct cda_results * result = NULL;
+	struct resolve_worker * workers = calloc(options->threads, sizeof(struct resolve_worker));
+	pthread_t * threads = calloc(options->threads, sizeof(pthread_t));
+	uint64_t * samples = malloc(options->resolves * sizeof(uint64_t));
+	const size_t share = options->resolves / options->threads;
+	uint64_t start = 0;
+	size_t failures = 0;
+	size_t counter = 0;
+
+	if(session == NULL || workers == NULL || threads == NULL || samples == NULL) {
+		fprintf(stderr, "resolve_all_ways: could not set up.\n");
+		free(samples);
+		free(threads);
+		free(workers);
+		libcda_session_destroy(session);
+		return;
+	}
+
+	printf("\n%-43s %10s %10s\n", "end to end", "resolves/s", "failures");
+	start = bench_clock();
+	for(counter = 0; counter < options->resolves; ++counter) {
+		samples[counter] = bench_clock();
+		result = libcda_session_get_url(session, urls[counter]);
+		samples[counter] = bench_clock() - samples[counter];
+		failures += result == NULL;
+		libcda_free_get_url(result);
+	}
+	printf("%-43s %10.1f %10zu\n", "single", options->resolves / ((bench_clock() - start) / 1e9), failures);
+
+	failures = 0;
+	start = bench_clock();
+	results = libcda_session_get_urls(session, (const char * const *)urls, options->resolves, options->concurrency, NULL);
+	for(counter = 0; counter < options->resolves; ++counter) failures += results == NULL || results[counter] == NULL;
+	printf("batch, concurrency %-24zu %10.1f %10zu\n", options->concurrency, options->resolves / ((bench_clock() - start) / 1e9), failures);
+	libcda_free_get_urls(results, options->resolves);
+
+	start = bench_clock();
+	failures = resolve_with_epoll(session, urls, options->resolves, options->concurrency);
+	printf("async on epoll, concurrency %-15zu %10.1f %10zu\n", options->concurrency, options->resolves / ((bench_clock() - start) / 1e9), failures);
+
+	failures = 0;
+	start = bench_clock();
+	for(counter = 0; counter < options->threads; ++counter) {
+		workers[counter].urls = urls + counter * share;
+		workers[counter].count = share;
+		workers[counter].drain_limit = options->drain_limit;
+		pthread_create(threads + counter, NULL, resolve_sequentially, workers + counter);
+	}
+	for(counter = 0; counter < options->threads; ++counter) {
+		pthread_join(threads[counter], NULL);
+		failures += workers[counter].failures;
+	}
+	printf("%-3zu threads, a session each %-15s %10.1f %10zu\n", options->threads, "", share * options->threads / ((bench_clock() - start) / 1e9), failures);
+
+	printf("\n%-32s %10s %10s %10s %10s\n", "single resolve, us", "p50", "p90", "p99", "max");
+	print_percentiles("libcda_session_get_url", samples, options->resolves, 1e3);
+
+	free(samples);
+	free(threads);
+	free(workers);
+	libcda_session_destroy(session);
+}
+
+/* The corpus is resolved round robin by the pages that start a video */
+static void time_end_to_end(const struct bench_options * options, const int port) {
+	char ** urls = calloc(options->resolves, sizeof(char *));
+	char * ids[8];
+	size_t id_count = 0;
+	size_t counter = 0;
+	int ready = urls != NULL;
+
+	for(counter = 0; counter < page_count && id_count < 8; ++counter) {
+		if(!strcmp(pages[counter].name, pages[counter].video_id)) ids[id_count++] = pages[counter].video_id;
+	}
+	for(counter = 0; ready && counter < options->resolves; ++counter) {
+		urls[counter] = malloc(64);
+		if(urls[counter] == NULL) ready = 0;
+		else snprintf(urls[counter], 64, "http://127.0.0.1:%d/video/%s", port, ids[counter % id_count]);
+	}
+	printf("\n%ld ms of server latency, %zu resolves over %zu videos\n", options->latency, options->resolves, id_count);
+	if(options->drain_limit >= 0) printf("pages drained up to %ld bytes left\n", options->drain_limit);
+	if(ready && id_count) resolve_all_ways(options, urls);
+	for(counter = 0; urls != NULL && counter < options->resolves; ++counter) free(urls[counter]);
+	free(urls);
+}
+
+static void print_usage(const char * program_name) {
+	fprintf(stderr, "Usage: %s [-d <corpus directory>] [-s <server binary>] [-l <latency in ms>]\n", program_name);
+	fputs("\t[-n <samples per stage>] [-r <resolves>] [-c <batch concurrency>] [-t <threads>]\n", stderr);
+	fputs("\t[-T <most threads to scale parsing to, all cores by default>]\n", stderr);
+	fputs("\t[-k <bytes of a page left to drain on HTTP/1.1, 0 cuts every page short>]\n", stderr);
+}
+
+int main(int argc, char * argv[]) {
+	struct bench_options options = {"bench/corpus", "bench/server", 0, 2000, 200, 8, 4, 0, -1};
+	pid_t server = 0;
+	int port = 0;
+	int opt;
+
+	while((opt = getopt(argc, argv, "d:s:l:n:r:c:t:T:k:h")) != -1) {
+		switch(opt) {
+			case 'd':
+				options.corpus = optarg;
+				break;
+			case 's':
+				options.server = optarg;
+				break;
+			case 'l':
+				options.latency = atol(optarg);
+				break;
+			case 'n':
+				options.iterations = strtoul(optarg, NULL, 10);
+				break;
+			case 'r':
+				options.resolves = strtoul(optarg, NULL, 10);
+				break;
+			case 'c':
+				options.concurrency = strtoul(optarg, NULL, 10);
+				break;
+			case 't':
+				options.threads = strtoul(optarg, NULL, 10);
+				break;
+			case 'T':
+				options.scaling_threads = strtoul(optarg, NULL, 10);
+				break;
+			case 'k':
+				options.drain_limit = atol(optarg);
+				break;
+			case 'h':
+			default:
+				print_usage(argv[0]);
+				return 1;
+		}
+	}
+	if(!options.iterations || !options.resolves || !options.threads) {
+		print_usage(argv[0]);
+		return 1;
+	}
+	if(!options.scaling_threads) options.scaling_threads = sysconf(_SC_NPROCESSORS_ONLN) > 0 ? sysconf(_SC_NPROCESSORS_ONLN) : 1;
+	if(load_corpus(options.corpus)) return 1;
+
+	printf("%zu pages, %s kernel\n\n", page_count, libcda_simd_kernel());
+	printf("%-32s %10s %10s %10s %10s\n", "stage, ns per call", "p50", "p90", "p99", "max");
+	time_stage("scan_for_player_data", stage_scan, 0, options.iterations);
+	time_stage("extract_raw_json_fast", stage_extract_fast, 0, options.iterations);
+	time_stage("extract_raw_json_with_libxml2", stage_extract_libxml2, 0, options.iterations);
+	time_stage("read_player_data_lazily", stage_json_lazy, 0, options.iterations);
+	time_stage("json_tokener_parse", stage_json_c, 0, options.iterations);
+	time_stage("decode_url", stage_decode_url, 1, options.iterations);
+	time_stage("decode_url_in_stages", stage_decode_url_in_stages, 1, options.iterations);
+	time_kernels(options.iterations);
+	time_scaling(options.iterations, options.scaling_threads);
+
+	libcda_global_init();
+	port = start_server(&options, &server);
+	if(port <= 0) {
+		fprintf(stderr, "main: could not start %s.\n", options.server);
+		if(server > 0) kill(server, SIGTERM);
+		return 1;
+	}
+	time_end_to_end(&options, port);
+	kill(server, SIGTERM);
+	waitpid(server, NULL, 0);
+	libcda_global_cleanup();
+	return 0;
+}
@@ -0,0 +1,222 @@
+// SPDX-License-Identifier: LicenseRef-Dual-LGPLv3-OR-CC-BY-ND-For-Rust
+#define _GNU_SOURCE
+#include <dirent.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+
+/* Stands in for cda.pl on the loopback interface. Serves the pages of a
+ * corpus directory, where GET /video/<id> is <id>.html and
+ * GET /video/<id>?wersja=<quality> is <id>_<quality>.html, falling back to
+ * <id>.html like the real site does. Every response waits the given latency
+ * first. Connections are kept alive, one thread each. */
+
+struct corpus_page {
+	char * name;
+	char * body;
+	size_t size;
+};
+
+static struct corpus_page * pages = NULL;
+static size_t page_count = 0;
+static long latency = 0;
+
+static int load_corpus(const char * directory) {
+	DIR * listing = opendir(directory);
+	struct dirent * entry = NULL;
+	struct corpus_page * bigger = NULL;
+	char path[4096];
+	FILE * file = NULL;
+	size_t name_length = 0;
+	long size = 0;
+	if(listing == NULL) {
+		fprintf(stderr, "load_corpus: could not open %s: %s\n", directory, strerror(errno));
+		return 1;
+	}
+	while((entry = readdir(listing)) != NULL) {
+		name_length = strlen(entry->d_name);
+		if(name_length <= 5 || strcmp(entry->d_name + name_length - 5, ".html")) continue;
+		snprintf(path, sizeof(path), "%s/%s", directory, entry->d_name);
+		file = fopen(path, "rb");
+		if(file == NULL) continue;
+		fseek(file, 0, SEEK_END);
+		size = ftell(file);
+		rewind(file);
+		bigger = realloc(pages, (page_count + 1) * sizeof(struct corpus_page));
+		if(bigger == NULL) {
+			fclose(file);
+			break;
+		}
+		pages = bigger;
+		pages[page_count].name = strndup(entry->d_name, name_length - 5);
+		pages[page_count].body = malloc(size);
+		pages[page_count].size = size;
+		if(pages[page_count].name != NULL && pages[page_count].body != NULL && fread(pages[page_count].body, 1, size, file) == (size_t)size) ++page_count;
+		fclose(file);
+	}
+	closedir(listing);
+	if(!page_count) fprintf(stderr, "load_corpus: no pages in %s.\n", directory);
+	return !page_count;
+}
+
+static const struct corpus_page * find_page(const char * name, const size_t length) {
+	size_t counter = 0;
+	for(; counter < page_count; ++counter) {
+		if(strlen(pages[counter].name) == length && !memcmp(pages[counter].name, name, length)) return pages + counter;
+	}
+	return NULL;
+}
+
+/* target is what follows GET, up to the space before the HTTP version */
+static const struct corpus_page * route(const char * target, const size_t length) {
+	static const char prefix[8] = "/video/";
+	static const char query[9] = "?wersja=";
+	const char * id = NULL;
+	const char * mark = NULL;
+	const struct corpus_page * result = NULL;
+	char name[512];
+	size_t id_length = 0;
+	size_t quality_length = 0;
+	if(length < 7 || memcmp(target, prefix, 7)) return NULL;
+	id = target + 7;
+	mark = memchr(id, '?', length - 7);
+	id_length = mark != NULL ? (size_t)(mark - id) : length - 7;
+	if(mark != NULL && (size_t)(target + length - mark) > 8 && !memcmp(mark, query, 8)) {
+		quality_length = target + length - mark - 8;
+		if(id_length + quality_length + 1 < sizeof(name)) {
+			memcpy(name, id, id_length);
+			name[id_length] = '_';
+			memcpy(name + id_length + 1, mark + 8, quality_length);
+			result = find_page(name, id_length + quality_length + 1);
+		}
+	}
+	if(result == NULL) result = find_page(id, id_length);
+	return result;
+}
+
+static int send_all(const int fd, const char * bytes, size_t length) {
+	ssize_t sent = 0;
+	while(length) {
+		sent = send(fd, bytes, length, MSG_NOSIGNAL);
+		if(sent <= 0) return 1;
+		bytes += sent;
+		length -= sent;
+	}
+	return 0;
+}
+
+static void * serve_connection(void * argument) {
+	const int fd = (int)(intptr_t)argument;
+	const struct corpus_page * page = NULL;
+	struct timespec pause = {latency / 1000, (latency % 1000) * 1000000};
+	char request[8192];
+	char head[256];
+	char * end = NULL;
+	char * target = NULL;
+	char * target_end = NULL;
+	size_t filled = 0;
+	size_t request_length = 0;
+	ssize_t received = 0;
+	int head_length = 0;
+	for(;;) {
+		end = filled ? memmem(request, filled, "\r\n\r\n", 4) : NULL;
+		if(end == NULL) {
+			if(filled == sizeof(request)) break;
+			received = recv(fd, request + filled, sizeof(request) - filled, 0);
+			if(received <= 0) break;
+			filled += received;
+			continue;
+		}
+		request_length = end + 4 - request;
+		target = memchr(request, ' ', request_length);
+		target_end = target != NULL ? memchr(target + 1, ' ', request + request_length - target - 1) : NULL;
+		page = target_end != NULL && !memcmp(request, "GET ", 4) ? route(target + 1, target_end - target - 1) : NULL;
+		if(latency) nanosleep(&pause, NULL);
+		if(page != NULL) {
+			head_length = snprintf(head, sizeof(head), "HTTP/1.1 200 OK\r\nContent-Type: text/html; charset=utf-8\r\nContent-Length: %zu\r\n\r\n", page->size);
+			if(send_all(fd, head, head_length) || send_all(fd, page->body, page->size)) break;
+		} else {
+			head_length = snprintf(head, sizeof(head), "HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\n\r\n");
+			if(send_all(fd, head, head_length)) break;
+		}
+		memmove(request, request + request_length, filled - request_length);
+		filled -= request_length;
+	}
+	close(fd);
+	return NULL;
+}
+
+static void print_usage(const char * program_name) {
+	fprintf(stderr, "Usage: %s -d <corpus directory> [-p <port>] [-l <latency in ms>]\n", program_name);
+	fputs("Port 0 picks a free one. The port in use is printed on the first line of stdout.\n", stderr);
+}
+
+int main(int argc, char * argv[]) {
+	struct sockaddr_in address = {0};
+	socklen_t address_length = sizeof(address);
+	pthread_attr_t detached;
+	pthread_t thread;
+	const char * directory = NULL;
+	int port = 0;
+	int listener = -1;
+	int connection = -1;
+	int yes = 1;
+	int opt;
+
+	while((opt = getopt(argc, argv, "d:p:l:h")) != -1) {
+		switch(opt) {
+			case 'd':
+				directory = optarg;
+				break;
+			case 'p':
+				port = atoi(optarg);
+				break;
+			case 'l':
+				latency = atol(optarg);
+				break;
+			case 'h':
+			default:
+				print_usage(argv[0]);
+				return 1;
+		}
+	}
+	if(directory == NULL) {
+		print_usage(argv[0]);
+		return 1;
+	}
+	if(load_corpus(directory)) return 1;
+
+	listener = socket(AF_INET, SOCK_STREAM, 0);
+	setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+	address.sin_family = AF_INET;
+	address.sin_port = htons(port);
+	address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	if(listener < 0 || bind(listener, (struct sockaddr *)&address, sizeof(address)) || listen(listener, 1024) || getsockname(listener, (struct sockaddr *)&address, &address_length)) {
+		fprintf(stderr, "main: could not listen on port %d: %s\n", port, strerror(errno));
+		return 1;
+	}
+	printf("%d\n", ntohs(address.sin_port));
+	fflush(stdout);
+
+	pthread_attr_init(&detached);
+	pthread_attr_setdetachstate(&detached, PTHREAD_CREATE_DETACHED);
+	for(;;) {
+		connection = accept(listener, NULL, NULL);
+		if(connection < 0) {
+			if(errno == EINTR || errno == ECONNABORTED) continue;
+			break;
+		}
+		setsockopt(connection, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(yes));
+		if(pthread_create(&thread, &detached, serve_connection, (void *)(intptr_t)connection)) close(connection);
+	}
+	return 0;
+}
@@ -2,5 +2,54 @@
 #include "get_url_struct.h"
 #include "get_url_signals.h"
 void libcda_free_get_url(struct cda_results * i);
+size_t libcda_results_size(const struct cda_results * i);
+struct cda_results * libcda_results_pack(const struct cda_results * i, void * buffer, const size_t size);
 struct cda_results * libcda_get_url(const char * cda_page_url);
+struct cda_results * libcda_get_url_in_quality(const char * cda_page_url, const int preference, const char * quality, int * status);
 void libcda_get_url2json(struct cda_results * i);
+char * libcda_results_json(const struct cda_results * i);
+struct libcda_session;
+struct libcda_session * libcda_session_create(void);
+struct cda_results * libcda_session_get_url(struct libcda_session * session, const char * cda_page_url);
+/* The strings on_url gets are only valid during the call; copy them to keep them */
+struct cda_results * libcda_session_get_url_progressively(struct libcda_session * session, const char * cda_page_url, libcda_url_callback on_url, void * userdata, int * status);
+struct cda_results * libcda_get_url_progressively(const char * cda_page_url, libcda_url_callback on_url, void * userdata, int * status);
+struct cda_results * libcda_session_get_url_lazily(struct libcda_session * session, const char * cda_page_url, int * status);
+struct cda_results * libcda_get_url_lazily(const char * cda_page_url, int * status);
+const char * libcda_results_url(struct libcda_session * session, struct cda_results * results, const size_t index);
+int libcda_results_prefetch(struct cda_results * results);
+struct cda_results * libcda_session_get_url_in_quality(struct libcda_session * session, const char * cda_page_url, const int preference, const char * quality, int * status);
+void libcda_session_destroy(struct libcda_session * session);
+int libcda_session_setopt(struct libcda_session * session, const int option, ...);
+int libcda_global_init(void);
+void libcda_global_cleanup(void);
+void libcda_free_get_urls(struct cda_results ** i, const size_t count);
+struct cda_results ** libcda_get_urls(const char * const * cda_page_urls, const size_t count, const size_t concurrency, int * statuses);
+struct cda_results ** libcda_session_get_urls(struct libcda_session * session, const char * const * cda_page_urls, const size_t count, const size_t concurrency, int * statuses);
+struct cda_results * libcda_session_get_url_with_stats(struct libcda_session * session, const char * cda_page_url, struct libcda_stats * stats);
+struct cda_results ** libcda_session_get_urls_with_stats(struct libcda_session * session, const char * const * cda_page_urls, const size_t count, const size_t concurrency, int * statuses, struct libcda_stats * stats);
+void libcda_session_get_stats(struct libcda_session * session, struct libcda_stats * stats);
+const char * libcda_simd_kernel(void);
+struct libcda_cache;
+struct libcda_cache * libcda_cache_create(const size_t max_entries, const long ttl);
+void libcda_cache_destroy(struct libcda_cache * cache);
+struct cda_results * libcda_cache_lookup(struct libcda_cache * cache, const char * cda_page_url, const char * quality);
+void libcda_cache_get_stats(struct libcda_cache * cache, struct libcda_cache_stats * stats);
+struct libcda_disk_cache;
+struct libcda_disk_cache * libcda_disk_cache_open(const char * path, const size_t slot_count, const long ttl);
+void libcda_disk_cache_close(struct libcda_disk_cache * cache);
+struct cda_results * libcda_disk_cache_lookup(struct libcda_disk_cache * cache, const char * cda_page_url, const char * quality);
+struct libcda_async;
+struct libcda_async * libcda_async_create(struct libcda_session * session, const size_t concurrency, libcda_socket_callback on_socket, libcda_timer_callback on_timer, void * userdata);
+void libcda_async_destroy(struct libcda_async * async);
+int libcda_async_get_url(struct libcda_async * async, const char * cda_page_url, libcda_result_callback on_result, void * userdata);
+int libcda_async_get_url_progressively(struct libcda_async * async, const char * cda_page_url, libcda_url_callback on_url, libcda_result_callback on_result, void * userdata);
+int libcda_async_perform(struct libcda_async * async, const int fd, const int events);
+struct libcda_parse;
+struct libcda_parse * libcda_parse_create(const char * cda_page_url);
+void libcda_parse_destroy(struct libcda_parse * parse);
+int libcda_parse_page(struct libcda_parse * parse, const char * page_url, const char * page, const size_t length);
+size_t libcda_parse_missing_urls(const struct libcda_parse * parse, const char ** page_urls, const size_t capacity);
+/* Until every missing page is in, the result comes with LIBCDA_STATUS_PARTIAL
+ * and NULL for the URLs of those pages */
+struct cda_results * libcda_parse_results(const struct libcda_parse * parse, int * status);
@@ -1,3 +1,29 @@
 #define LIBCDA_VIDEO_NOT_SUPPORTED	0
 #define LIBCDA_VIDEO_IS_FILE		1
 #define LIBCDA_VIDEO_IS_M3U8		2
+#define LIBCDA_STATUS_OK		0
+#define LIBCDA_STATUS_BAD_PAGE_URL	1
+#define LIBCDA_STATUS_DOWNLOAD_FAILED	2
+#define LIBCDA_STATUS_PARSING_FAILED	3
+#define LIBCDA_STATUS_NOT_SUPPORTED	4
+#define LIBCDA_STATUS_OUT_OF_MEMORY	5
+#define LIBCDA_STATUS_CANCELLED		6
+#define LIBCDA_STATUS_NO_SUCH_QUALITY	7
+#define LIBCDA_STATUS_PARTIAL		8
+#define LIBCDA_OPT_JSON_PARSER		1
+#define LIBCDA_OPT_CACHE		2
+#define LIBCDA_OPT_DISK_CACHE		3
+#define LIBCDA_OPT_HTTP2		4
+#define LIBCDA_OPT_COMPRESSION		5
+#define LIBCDA_OPT_DRAIN_LIMIT		6
+#define LIBCDA_JSON_PARSER_LAZY		0L
+#define LIBCDA_JSON_PARSER_JSON_C	1L
+#define LIBCDA_QUALITY_ALL		0
+#define LIBCDA_QUALITY_EXACT		1
+#define LIBCDA_QUALITY_AT_MOST		2
+#define LIBCDA_QUALITY_BEST		3
+#define LIBCDA_POLL_IN			1
+#define LIBCDA_POLL_OUT			2
+#define LIBCDA_POLL_INOUT		3
+#define LIBCDA_POLL_REMOVE		4
+#define LIBCDA_SOCKET_TIMEOUT		-1
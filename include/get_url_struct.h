@@ -1,8 +1,52 @@
 // SPDX-License-Identifier: LicenseRef-Dual-LGPLv3-OR-CC-BY-ND-For-Rust
+struct libcda_lazy_urls;
+
+/* lazy is set while some url entries are still to be resolved, see
+ * libcda_results_url */
 struct cda_results {
 	char ** quality;
 	char ** url;
 	size_t quality_count;
 	size_t url_count;
 	char json_type;
+	struct libcda_lazy_urls * lazy;
 };
+
+struct libcda_cache_stats {
+	size_t hits;
+	size_t misses;
+	size_t expirations;
+	size_t insertions;
+	size_t evictions;
+	size_t entries;
+};
+
+/* What a resolve spent its time on. Times are in nanoseconds. The network
+ * ones are summed over every page fetched, so with fetches running side by
+ * side they can add up to more than resolve_time. */
+struct libcda_stats {
+	size_t resolves;
+	size_t cache_hits;
+	size_t fetches;
+	size_t quality_fetches;
+	size_t bytes_downloaded;
+	size_t bytes_decoded;
+	unsigned long long dns_time;
+	unsigned long long connect_time;
+	unsigned long long tls_time;
+	unsigned long long first_byte_time;
+	unsigned long long fetch_time;
+	unsigned long long slowest_fetch_time;
+	unsigned long long html_time;
+	unsigned long long json_time;
+	unsigned long long decode_time;
+	unsigned long long resolve_time;
+};
+
+typedef void (*libcda_result_callback)(struct cda_results * result, const int status, const struct libcda_stats * stats, void * userdata);
+/* quality and url of a libcda_url_callback point into a buffer libcda
+ * reallocates as the resolve goes on, so they are only valid during the
+ * call and must be copied to be kept. */
+typedef void (*libcda_url_callback)(const char * quality, const char * url, const int status, void * userdata);
+typedef void (*libcda_socket_callback)(const int fd, const int events, void * userdata);
+typedef void (*libcda_timer_callback)(const long timeout, void * userdata);
@@ -1,13 +1,11 @@
 // SPDX-License-Identifier: LicenseRef-Dual-LGPLv3-OR-CC-BY-ND-For-Rust
 #include <immintrin.h>
-#define ALIGNMENT 32
-#define ALIGNMENT_BITSHIFT 5
-#define ALIGNMENT_MASK 31
-#define LIBCDA_URL_DECODING_IS_OPTIMIZED
 
-static void weird_decoding_ritual(__m256i * inplace, const size_t length) {
+__attribute__((target("avx2")))
+static void weird_decoding_ritual_avx2(char * string, const size_t length) {
+	__m256i * inplace = (__m256i *)string;
 	size_t counter;
-	size_t vec_length = ((length + ALIGNMENT_MASK) & (~ALIGNMENT_MASK)) >> ALIGNMENT_BITSHIFT;
+	size_t vec_length = (length + sizeof(__m256i) - 1) / sizeof(__m256i);
 	__m256i forty_seven = _mm256_set1_epi8(47);
 	__m256i seventy_nine = _mm256_set1_epi8(79);
 	__m256i ninety_four = _mm256_set1_epi8(94);
@@ -22,3 +20,86 @@ static void weird_decoding_ritual(__m256i * inplace, const size_t length) {
 		_mm256_store_si256(inplace + counter, data);
 	}
 }
+
+/* Bit n is set when string[n] is '_' or '%', which is where every token and
+ * escape in a file string begins. Looks at no more than 64 bytes. */
+__attribute__((target("avx2")))
+static uint64_t url_candidates_avx2(const char * string, const size_t length) {
+	__m256i underscore = _mm256_set1_epi8('_');
+	__m256i percent = _mm256_set1_epi8('%');
+	__m256i data;
+	uint64_t mask = 0;
+	size_t counter = 0;
+	for(; counter < 64 && counter + sizeof(__m256i) <= length; counter += sizeof(__m256i)) {
+		data = _mm256_loadu_si256((const __m256i *)(string + counter));
+		mask |= (uint64_t)(unsigned int)_mm256_movemask_epi8(_mm256_or_si256(_mm256_cmpeq_epi8(data, underscore), _mm256_cmpeq_epi8(data, percent))) << counter;
+	}
+	for(; counter < 64 && counter < length; ++counter) mask |= (uint64_t)(string[counter] == '_' || string[counter] == '%') << counter;
+	return mask;
+}
+
+/* unescape_url_bytes_ssse3 on twice the lanes. */
+__attribute__((target("avx2")))
+static __m256i unescape_url_bytes_avx2(const __m256i high, const __m256i low) {
+	__m256i nibble = _mm256_set1_epi8(0xF);
+	__m256i nine = _mm256_set1_epi8(9);
+	__m256i minus_nine = _mm256_set1_epi8(-9);
+	__m256i zero = _mm256_setzero_si256();
+	__m256i h = _mm256_and_si256(high, nibble);
+	__m256i l = _mm256_and_si256(low, nibble);
+	h = _mm256_add_epi8(h, _mm256_and_si256(_mm256_cmpgt_epi8(high, _mm256_set1_epi8(63)), nine));
+	h = _mm256_add_epi8(h, _mm256_and_si256(_mm256_cmpgt_epi8(zero, high), minus_nine));
+	h = _mm256_add_epi8(h, _mm256_and_si256(_mm256_cmpgt_epi8(_mm256_set1_epi8(-64), high), minus_nine));
+	l = _mm256_add_epi8(l, _mm256_and_si256(_mm256_cmpgt_epi8(low, _mm256_set1_epi8(63)), nine));
+	l = _mm256_add_epi8(l, _mm256_and_si256(_mm256_cmpgt_epi8(zero, low), minus_nine));
+	l = _mm256_add_epi8(l, _mm256_and_si256(_mm256_cmpgt_epi8(_mm256_set1_epi8(-64), low), minus_nine));
+	return _mm256_or_si256(_mm256_and_si256(_mm256_slli_epi16(h, 4), _mm256_set1_epi8(-16)), l);
+}
+
+/* Packs the bytes of half whose bits are set in kept to output and says how
+ * many there were. Always stores 8 bytes. */
+__attribute__((target("avx2")))
+static size_t compact_url_bytes_avx2(char * output, const __m128i half, const unsigned int kept) {
+	_mm_storel_epi64((__m128i *)output, _mm_shuffle_epi8(half, _mm_loadl_epi64((const __m128i *)unquote_shuffles[kept & 0xFF])));
+	output += __builtin_popcount(kept & 0xFF);
+	_mm_storel_epi64((__m128i *)output, _mm_shuffle_epi8(_mm_srli_si128(half, 8), _mm_loadl_epi64((const __m128i *)unquote_shuffles[kept >> 8])));
+	return __builtin_popcount(kept);
+}
+
+/* unquote_ssse3 32 bytes at a time, using its shuffle table since AVX2 has no
+ * byte compress either. */
+__attribute__((target("avx2")))
+static size_t unquote_avx2(char * output, const char * input, const size_t length, size_t * consumed) {
+	size_t read_counter = 0;
+	size_t write_counter = 0;
+	size_t tail_consumed;
+	__m256i percent = _mm256_set1_epi8('%');
+	__m256i data;
+	__m256i escapes;
+	__m256i decoded;
+	uint64_t starts;
+	uint64_t digits;
+	uint64_t kept;
+	while(read_counter + sizeof(__m256i) + 2 <= length) {
+		data = _mm256_loadu_si256((const __m256i *)(input + read_counter));
+		escapes = _mm256_cmpeq_epi8(data, percent);
+		starts = (unsigned int)_mm256_movemask_epi8(escapes);
+		if(!starts) {
+			_mm256_storeu_si256((__m256i *)(output + write_counter), data);
+			read_counter += sizeof(__m256i);
+			write_counter += sizeof(__m256i);
+			continue;
+		}
+		digits = (starts << 1) | (starts << 2);
+		if(starts & digits) break;
+		decoded = unescape_url_bytes_avx2(_mm256_loadu_si256((const __m256i *)(input + read_counter + 1)), _mm256_loadu_si256((const __m256i *)(input + read_counter + 2)));
+		data = _mm256_blendv_epi8(data, decoded, escapes);
+		kept = ~digits & 0xFFFFFFFF;
+		write_counter += compact_url_bytes_avx2(output + write_counter, _mm256_castsi256_si128(data), kept & 0xFFFF);
+		write_counter += compact_url_bytes_avx2(output + write_counter, _mm256_extracti128_si256(data, 1), kept >> 16);
+		read_counter += sizeof(__m256i) + __builtin_popcountll(digits >> 32);
+	}
+	write_counter += unquote_generic(output + write_counter, input + read_counter, length - read_counter, &tail_consumed);
+	*consumed = read_counter + tail_consumed;
+	return write_counter;
+}
@@ -1,9 +1,5 @@
 // SPDX-License-Identifier: LicenseRef-Dual-LGPLv3-OR-CC-BY-ND-For-Rust
 #include <immintrin.h>
-#define ALIGNMENT 64
-#define ALIGNMENT_BITSHIFT 6
-#define ALIGNMENT_MASK 63
-#define LIBCDA_URL_DECODING_IS_OPTIMIZED
 
 /* Since AVX512 is such a clusterfuck, we need to lay down what instructions we
  * use in order to determine what subsets of AVX512 we're using.
@@ -18,9 +14,11 @@
  * 	_mm512_sub_epi8
  */
 
-static void weird_decoding_ritual(__m512i * inplace, const size_t length) {
+__attribute__((target("avx512f,avx512bw")))
+static void weird_decoding_ritual_avx512(char * string, const size_t length) {
+	__m512i * inplace = (__m512i *)string;
 	size_t counter;
-	size_t vec_length = ((length + ALIGNMENT_MASK) & (~ALIGNMENT_MASK)) >> ALIGNMENT_BITSHIFT;
+	size_t vec_length = (length + sizeof(__m512i) - 1) / sizeof(__m512i);
 	__m512i forty_seven = _mm512_set1_epi8(47);
 	__m512i seventy_nine = _mm512_set1_epi8(79);
 	__m512i ninety_four = _mm512_set1_epi8(94);
@@ -34,3 +32,107 @@ static void weird_decoding_ritual(__m512i * inplace, const size_t length) {
 		_mm512_store_si512(inplace + counter, data);
 	}
 }
+
+/* Bit n is set when string[n] is '_' or '%', which is where every token and
+ * escape in a file string begins. Looks at no more than 64 bytes; a short
+ * string goes through a masked load, which doesn't fault on the bytes it
+ * leaves out.
+ * AVX512BW:
+ * 	_mm512_cmpeq_epi8_mask,
+ * 	_mm512_maskz_loadu_epi8
+ */
+__attribute__((target("avx512f,avx512bw")))
+static uint64_t url_candidates_avx512(const char * string, const size_t length) {
+	__m512i underscore = _mm512_set1_epi8('_');
+	__m512i percent = _mm512_set1_epi8('%');
+	__m512i data;
+	if(length >= sizeof(__m512i)) data = _mm512_loadu_si512(string);
+	else data = _mm512_maskz_loadu_epi8(((__mmask64)1 << length) - 1, string);
+	return _mm512_cmpeq_epi8_mask(data, underscore) | _mm512_cmpeq_epi8_mask(data, percent);
+}
+
+/* unescape_url_byte on every lane, with the -2..1 that c >> 6 stands for
+ * applied through compare masks.
+ * AVX512BW:
+ * 	_mm512_cmpgt_epi8_mask,
+ * 	_mm512_cmplt_epi8_mask,
+ * 	_mm512_mask_add_epi8,
+ * 	_mm512_mask_sub_epi8,
+ * 	_mm512_slli_epi16
+ */
+__attribute__((target("avx512f,avx512bw")))
+static __m512i unescape_url_bytes_avx512(const __m512i high, const __m512i low) {
+	__m512i nibble = _mm512_set1_epi8(0xF);
+	__m512i nine = _mm512_set1_epi8(9);
+	__m512i sixty_three = _mm512_set1_epi8(63);
+	__m512i minus_sixty_four = _mm512_set1_epi8(-64);
+	__m512i zero = _mm512_setzero_si512();
+	__m512i h = _mm512_and_si512(high, nibble);
+	__m512i l = _mm512_and_si512(low, nibble);
+	h = _mm512_mask_add_epi8(h, _mm512_cmpgt_epi8_mask(high, sixty_three), h, nine);
+	h = _mm512_mask_sub_epi8(h, _mm512_cmplt_epi8_mask(high, zero), h, nine);
+	h = _mm512_mask_sub_epi8(h, _mm512_cmplt_epi8_mask(high, minus_sixty_four), h, nine);
+	l = _mm512_mask_add_epi8(l, _mm512_cmpgt_epi8_mask(low, sixty_three), l, nine);
+	l = _mm512_mask_sub_epi8(l, _mm512_cmplt_epi8_mask(low, zero), l, nine);
+	l = _mm512_mask_sub_epi8(l, _mm512_cmplt_epi8_mask(low, minus_sixty_four), l, nine);
+	return _mm512_or_si512(_mm512_and_si512(_mm512_slli_epi16(h, 4), _mm512_set1_epi8(-16)), l);
+}
+
+/* unquote_generic 64 bytes at a time. Every load is masked, so the last
+ * block needs no scalar tail, and the digits are only loaded for the lanes
+ * holding a '%'. The compress happens in a register and the store is masked
+ * to what is left, as a compressing store is slow on some cores. An escape
+ * in the last two lanes takes its digits from the next block, which then
+ * starts after them.
+ * AVX512BW:
+ * 	_mm512_mask_mov_epi8,
+ * 	_mm512_mask_storeu_epi8
+ * AVX512_VBMI2:
+ * 	_mm512_maskz_compress_epi8
+ */
+__attribute__((target("avx512f,avx512bw,avx512vbmi2")))
+static size_t unquote_avx512(char * output, const char * input, const size_t length, size_t * consumed) {
+	size_t read_counter = 0;
+	size_t write_counter = 0;
+	size_t tail_consumed;
+	size_t available;
+	size_t block;
+	size_t written;
+	int truncated = 0;
+	__m512i percent = _mm512_set1_epi8('%');
+	__m512i data;
+	__mmask64 in_block;
+	__mmask64 starts;
+	__mmask64 complete;
+	__mmask64 digits;
+	__mmask64 kept;
+	while(read_counter < length) {
+		available = length - read_counter;
+		block = available < sizeof(__m512i) ? available : sizeof(__m512i);
+		in_block = block < sizeof(__m512i) ? ((__mmask64)1 << block) - 1 : ~(__mmask64)0;
+		data = _mm512_maskz_loadu_epi8(in_block, input + read_counter);
+		starts = _mm512_cmpeq_epi8_mask(data, percent);
+		digits = (starts << 1) | (starts << 2);
+		/* A '%' that is another escape's digit; leave the rest to the scalar loop. */
+		if(starts & digits) break;
+		/* An escape whose digits run past length ends the input we can use. */
+		complete = available >= sizeof(__m512i) + 2 ? ~(__mmask64)0 : available > 2 ? ((__mmask64)1 << (available - 2)) - 1 : 0;
+		if(starts & ~complete) {
+			block = __builtin_ctzll(starts & ~complete);
+			in_block = ((__mmask64)1 << block) - 1;
+			starts &= in_block;
+			digits &= in_block;
+			truncated = 1;
+		}
+		if(starts) data = _mm512_mask_mov_epi8(data, starts, unescape_url_bytes_avx512(_mm512_maskz_loadu_epi8(starts, input + read_counter + 1), _mm512_maskz_loadu_epi8(starts, input + read_counter + 2)));
+		kept = ~digits & in_block;
+		written = __builtin_popcountll(kept);
+		_mm512_mask_storeu_epi8(output + write_counter, written < sizeof(__m512i) ? ((__mmask64)1 << written) - 1 : ~(__mmask64)0, _mm512_maskz_compress_epi8(kept, data));
+		write_counter += written;
+		read_counter += block + (starts >> 63) * 2 + ((starts >> 62) & 1);
+		if(truncated) break;
+	}
+	write_counter += unquote_generic(output + write_counter, input + read_counter, length - read_counter, &tail_consumed);
+	*consumed = read_counter + tail_consumed;
+	return write_counter;
+}
@@ -1,5 +1,45 @@
 // SPDX-License-Identifier: LicenseRef-Dual-LGPLv3-OR-CC-BY-ND-For-Rust
-static void weird_decoding_ritual(char * inplace, const size_t length) {
+/* Written the way the vector kernels do it rather than as 33 + (c + 14) % 94,
+ * which only agrees with them on printable bytes. */
+static char rotate_url_byte(const char c) {
+	return c + 47 - (-((signed char)c > 79) & 94);
+}
+
+/* Turns the two bytes after a '%' into one without checking they are hex,
+ * exactly as the original unquote did. */
+static char unescape_url_byte(const char high, const char low) {
+	return (((high & 0xF) + (high >> 6) * 9) << 4) | ((low & 0xF) + (low >> 6) * 9);
+}
+
+static void weird_decoding_ritual_generic(char * inplace, const size_t length) {
 	size_t counter = 0;
-	for(; counter < length; ++counter) inplace[counter] = (33 + ((inplace[counter] + 14) % 94));
+	for(; counter < length; ++counter) inplace[counter] = rotate_url_byte(inplace[counter]);
+}
+
+/* Bit n is set when string[n] is '_' or '%', which is where every token and
+ * escape in a file string begins. Looks at no more than 64 bytes. */
+static uint64_t url_candidates_generic(const char * string, const size_t length) {
+	uint64_t mask = 0;
+	size_t counter = 0;
+	for(; counter < 64 && counter < length; ++counter) mask |= (uint64_t)(string[counter] == '_' || string[counter] == '%') << counter;
+	return mask;
+}
+
+/* Every '%' and the two bytes after it become one byte. Stops short of an
+ * escape that would run past length and reports how much input it used.
+ * output may be input itself, as it never gets ahead of it. */
+static size_t unquote_generic(char * output, const char * input, const size_t length, size_t * consumed) {
+	size_t read_counter = 0;
+	size_t write_counter = 0;
+	while(read_counter < length) {
+		if(input[read_counter] != '%') {
+			output[write_counter++] = input[read_counter++];
+			continue;
+		}
+		if(read_counter + 2 >= length) break;
+		output[write_counter++] = unescape_url_byte(input[read_counter + 1], input[read_counter + 2]);
+		read_counter += 3;
+	}
+	*consumed = read_counter;
+	return write_counter;
 }
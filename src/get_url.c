@@ -1,8 +1,21 @@
 // SPDX-License-Identifier: LicenseRef-Dual-LGPLv3-OR-CC-BY-ND-For-Rust
+#define _GNU_SOURCE
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
+#include <time.h>
 #include <unistd.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <curl/curl.h>
 #include <libxml/xpath.h>
 #include <libxml/HTMLparser.h>
@@ -10,41 +23,150 @@
 
 #include "get_url_struct.h"
 #include "get_url_signals.h"
+#include "get_url_internal.h"
 
 /* Compile with:
  * gcc -ljson-c -lcurl $(xml2-config --libs) $(xml2-config --cflags) -O2 -Wall -Wextra -pedantic cda2url-unoptimized.c -o cda2url
  */
 
-struct known_size_memory_region {
-	char * memory;
-	size_t size;
-};
+/* A cda_results and everything it points to sit in one block: the header,
+ * the quality pointers, the url pointers, then the strings back to back.
+ * Nothing in it is allocated on its own, so a single free releases it. */
+static size_t results_size(const size_t quality_count, const size_t url_count, const size_t string_bytes) {
+	return sizeof(struct cda_results) + (quality_count + url_count) * sizeof(char *) + string_bytes;
+}
+
+/* Sets up the header and pointer tables at buffer and returns where the
+ * strings go. */
+static char * lay_out_results(void * buffer, const size_t quality_count, const size_t url_count, const char json_type) {
+	struct cda_results * result = buffer;
+	result->quality = (char **)(result + 1);
+	result->url = result->quality + quality_count;
+	result->quality_count = quality_count;
+	result->url_count = url_count;
+	result->json_type = json_type;
+	result->lazy = NULL;
+	return (char *)(result->url + url_count);
+}
+
+static void free_lazy_urls(struct cda_results * i);
+static void lock_lazy_urls(const struct cda_results * i);
+static void unlock_lazy_urls(const struct cda_results * i);
 
+/* A lazy result also owns the URLs resolved after it was made. */
 void libcda_free_get_url(struct cda_results * i) {
+	if(i != NULL && i->lazy != NULL) free_lazy_urls(i);
+	free(i);
+}
+
+static size_t unlocked_results_size(const struct cda_results * i) {
+	size_t string_bytes = 0;
 	size_t counter = 0;
-	if(i != NULL) {
-		if(i->quality != NULL) {
-			for(counter = 0; counter < i->quality_count; ++counter) {
-				if(i->quality[counter] != NULL) {
-					free(i->quality[counter]);
-					i->quality[counter] = NULL;
-				}
-			}
+	for(counter = 0; counter < i->quality_count; ++counter) string_bytes += strlen(i->quality[counter]) + 1;
+	for(counter = 0; counter < i->url_count; ++counter) {
+		if(i->url[counter] != NULL) string_bytes += strlen(i->url[counter]) + 1;
+	}
+	return results_size(i->quality_count, i->url_count, string_bytes);
+}
+
+size_t libcda_results_size(const struct cda_results * i) {
+	size_t result = 0;
+	if(i == NULL) return 0;
+	lock_lazy_urls(i);
+	result = unlocked_results_size(i);
+	unlock_lazy_urls(i);
+	return result;
+}
+
+/* Copies i into a buffer of the caller's, which has to be aligned like
+ * anything malloc returns. The copy points only into the buffer and must
+ * not be passed to libcda_free_get_url. A lazy result is copied as it is
+ * at the time, and the copy is not lazy: URLs missing then stay NULL. */
+struct cda_results * libcda_results_pack(const struct cda_results * i, void * buffer, const size_t size) {
+	struct cda_results * result = buffer;
+	char * strings = NULL;
+	size_t length = 0;
+	size_t counter = 0;
+	if(i == NULL || buffer == NULL) return NULL;
+	if((uintptr_t)buffer % sizeof(void *)) {
+		fprintf(stderr, "libcda_results_pack: buffer is not aligned.\n");
+		return NULL;
+	}
+	lock_lazy_urls(i);
+	if(size < unlocked_results_size(i)) {
+		unlock_lazy_urls(i);
+		fprintf(stderr, "libcda_results_pack: buffer of %zu bytes is too small.\n", size);
+		return NULL;
+	}
+	strings = lay_out_results(buffer, i->quality_count, i->url_count, i->json_type);
+	for(counter = 0; counter < i->quality_count; ++counter) {
+		length = strlen(i->quality[counter]) + 1;
+		result->quality[counter] = memcpy(strings, i->quality[counter], length);
+		strings += length;
+	}
+	for(counter = 0; counter < i->url_count; ++counter) {
+		result->url[counter] = NULL;
+		if(i->url[counter] == NULL) continue;
+		length = strlen(i->url[counter]) + 1;
+		result->url[counter] = memcpy(strings, i->url[counter], length);
+		strings += length;
+	}
+	unlock_lazy_urls(i);
+	return result;
+}
+
+void free_results_draft(struct results_draft * draft) {
+	free(draft->strings);
+	free(draft->quality);
+	free(draft->url);
+	memset(draft, 0, sizeof(struct results_draft));
+}
+
+/* Makes room for bytes more bytes of strings and returns where they go. */
+static char * reserve_draft_strings(struct results_draft * draft, const size_t bytes) {
+	size_t capacity = draft->strings_capacity ? draft->strings_capacity : 256;
+	char * strings = NULL;
+	while(capacity - draft->strings_size < bytes) capacity <<= 1;
+	if(capacity != draft->strings_capacity) {
+		strings = realloc(draft->strings, capacity);
+		if(strings == NULL) {
+			fprintf(stderr, "reserve_draft_strings: could not allocate %zu bytes.\n", capacity);
+			return NULL;
 		}
-		free(i->quality);
-		i->quality = NULL;
-		if(i->url != NULL) {
-			for(counter = 0; counter < i->url_count; ++counter) {
-				if(i->url[counter] != NULL) {
-					free(i->url[counter]);
-					i->url[counter] = NULL;
-				}
-			}
+		draft->strings = strings;
+		draft->strings_capacity = capacity;
+	}
+	return draft->strings + draft->strings_size;
+}
+
+static const char * draft_string(const struct results_draft * draft, const size_t offset) {
+	return draft->strings + offset;
+}
+
+/* The one allocation the caller gets back. Every url has to be there,
+ * unless missing ones are allowed, which then are NULL. */
+static struct cda_results * pack_results_draft(const struct results_draft * draft, const int allow_missing) {
+	struct cda_results * result = NULL;
+	char * strings = NULL;
+	size_t counter = 0;
+	for(counter = 0; counter < draft->url_count && !allow_missing; ++counter) {
+		if(draft->url[counter] == RESULTS_DRAFT_NO_STRING) {
+			fprintf(stderr, "pack_results_draft: url %zu is missing.\n", counter);
+			return NULL;
 		}
-		free(i->url);
-		i->url = NULL;
 	}
-	free(i);
+	result = malloc(results_size(draft->quality_count, draft->url_count, draft->strings_size));
+	if(result == NULL) {
+		fprintf(stderr, "pack_results_draft: could not allocate memory for results.\n");
+		return NULL;
+	}
+	strings = lay_out_results(result, draft->quality_count, draft->url_count, draft->json_type);
+	if(draft->strings_size) memcpy(strings, draft->strings, draft->strings_size);
+	for(counter = 0; counter < draft->quality_count; ++counter) result->quality[counter] = strings + draft->quality[counter];
+	for(counter = 0; counter < draft->url_count; ++counter) {
+		result->url[counter] = draft->url[counter] != RESULTS_DRAFT_NO_STRING ? strings + draft->url[counter] : NULL;
+	}
+	return result;
 }
 
 static size_t write_memory_callback(void *contents, size_t size, size_t nmemb, void *userdata) {
@@ -76,6 +198,90 @@ static void free_memory_chunk(struct known_size_memory_region * i) {
 	free(i);
 }
 
+static int is_html_space(const char c) {
+	return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\f';
+}
+
+/* Checks that the needle found at position is the whole value of an id
+ * attribute of a div, and remembers where that div starts. */
+static int is_player_element(struct player_data_scanner * scanner, const char * memory, const size_t position) {
+	const char after = memory[position + scanner->needle_length];
+	const char * tag_start = NULL;
+	size_t counter = position;
+	char quote = 0;
+
+	if(counter && (memory[counter - 1] == '"' || memory[counter - 1] == '\'')) quote = memory[--counter];
+	if(quote ? after != quote : !(is_html_space(after) || after == '>' || after == '/')) return 0;
+	while(counter && is_html_space(memory[counter - 1])) --counter;
+	if(!counter || memory[--counter] != '=') return 0;
+	while(counter && is_html_space(memory[counter - 1])) --counter;
+	if(counter < 3 || strncasecmp(memory + counter - 2, "id", 2) || !is_html_space(memory[counter - 3])) return 0;
+
+	tag_start = memrchr(memory, '<', counter - 3);
+	if(tag_start == NULL || strncasecmp(tag_start + 1, "div", 3) || !is_html_space(tag_start[4])) return 0;
+
+	scanner->element_start = tag_start - memory;
+	scanner->tag_position = position + scanner->needle_length;
+	scanner->quote = quote;
+	return 1;
+}
+
+/* Returns 1 once the start tag of the player element has arrived in full */
+int scan_for_player_data(struct player_data_scanner * scanner, const struct known_size_memory_region * page) {
+	const char * found = NULL;
+	const char * memory = page->memory;
+	const size_t size = page->size;
+	size_t position = 0;
+
+	while(scanner->state == PLAYER_SCANNER_LOOKING) {
+		found = NULL;
+		if(scanner->search_from < size) {
+			found = memmem(memory + scanner->search_from, size - scanner->search_from, scanner->needle, scanner->needle_length);
+		}
+		if(found == NULL) {
+			if(size >= scanner->needle_length && size - scanner->needle_length + 1 > scanner->search_from) {
+				scanner->search_from = size - scanner->needle_length + 1;
+			}
+			return 0;
+		}
+		position = found - memory;
+/* Whatever follows the needle tells whether it is the whole attribute value */
+		if(position + scanner->needle_length >= size) {
+			scanner->search_from = position;
+			return 0;
+		}
+		if(is_player_element(scanner, memory, position)) scanner->state = PLAYER_SCANNER_IN_TAG;
+		else scanner->search_from = position + 1;
+	}
+
+	while(scanner->state == PLAYER_SCANNER_IN_TAG && scanner->tag_position < size) {
+		if(scanner->quote) {
+			found = memchr(memory + scanner->tag_position, scanner->quote, size - scanner->tag_position);
+			if(found == NULL) {
+				scanner->tag_position = size;
+			} else {
+				scanner->tag_position = found - memory + 1;
+				scanner->quote = 0;
+			}
+		} else {
+			switch(memory[scanner->tag_position++]) {
+				case '"':
+					scanner->quote = '"';
+					break;
+				case '\'':
+					scanner->quote = '\'';
+					break;
+				case '>':
+					scanner->element_end = scanner->tag_position;
+					scanner->state = PLAYER_SCANNER_DONE;
+					break;
+			}
+		}
+	}
+
+	return scanner->state == PLAYER_SCANNER_DONE;
+}
+
 static char * get_curl_user_agent(void) {
 	static char user_agent_beginning[6] = "curl/";
 	static size_t user_agent_beginning_length = 5;
@@ -86,18 +292,15 @@ static char * get_curl_user_agent(void) {
 	version_length = strlen(info->version);
 	user_agent_length += version_length;
 	user_agent = malloc(user_agent_length + 1);
+	if(user_agent == NULL) return NULL;
 	memcpy(user_agent, user_agent_beginning, user_agent_beginning_length);
 	memcpy(user_agent + user_agent_beginning_length, info->version, version_length);
 	user_agent[user_agent_length] = '\0';
 	return user_agent;
 }
 
-static struct known_size_memory_region * http_get_with_curl(const char * cda_url) {
-	struct known_size_memory_region * chunk = NULL;
-	char * user_agent = NULL;
-	CURL * curl = NULL;
-	CURLcode response = 0;
-	chunk = malloc(sizeof(struct known_size_memory_region));
+static struct known_size_memory_region * new_memory_chunk(void) {
+	struct known_size_memory_region * chunk = malloc(sizeof(struct known_size_memory_region));
 	if(chunk == NULL) return NULL;
 	chunk->memory = malloc(1);
 	if(chunk->memory == NULL) {
@@ -105,24 +308,281 @@ static struct known_size_memory_region * http_get_with_curl(const char * cda_url
 		return NULL;
 	}
 	chunk->size = 0;
-	curl = curl_easy_init();
-	if(curl == NULL) {
-		free(chunk->memory);
-		free(chunk);
+	return chunk;
+}
+
+/* A session keeps everything that can outlive a single page fetch: curl
+ * handles together with their connections, a share of DNS lookups, TLS
+ * sessions and connections, and the user agent string. A session must not
+ * be used by more than one thread at a time, but any number of threads can
+ * resolve at once with a session each. Caches are safe to share between
+ * sessions in any thread. */
+struct libcda_session {
+	CURLSH * share;
+	CURLM * multi;
+	CURL ** idle_handles;
+	size_t idle_count;
+	size_t idle_capacity;
+	char * user_agent;
+	struct libcda_cache * cache;
+	struct libcda_disk_cache * disk_cache;
+	struct libcda_stats stats;
+	int json_parser;
+	int http2;
+	int compression;
+	long drain_limit;
+};
+
+/* Every thread gets a default session of its own, which goes away with
+ * the thread, so libcda_get_url can be called from anywhere. */
+static pthread_key_t default_session_key;
+static pthread_once_t default_session_once = PTHREAD_ONCE_INIT;
+static int global_init_count = 0;
+
+/* Default sessions hold curl handles until their threads exit, so the
+ * global cleanups asked for while any is alive wait for the last of them. */
+static pthread_mutex_t global_lock = PTHREAD_MUTEX_INITIALIZER;
+static size_t live_default_sessions = 0;
+static size_t deferred_global_cleanups = 0;
+
+void libcda_session_destroy(struct libcda_session * session) {
+	size_t counter = 0;
+	if(session != NULL) {
+		for(counter = 0; counter < session->idle_count; ++counter) {
+			curl_easy_cleanup(session->idle_handles[counter]);
+		}
+		free(session->idle_handles);
+		curl_multi_cleanup(session->multi);
+		curl_share_cleanup(session->share);
+		free(session->user_agent);
+	}
+	free(session);
+}
+
+/* Streams of one connection are only shared with HTTP/2 on */
+static long session_pipelining(const struct libcda_session * session) {
+	return session->http2 ? CURLPIPE_MULTIPLEX : CURLPIPE_NOTHING;
+}
+
+/* What is left of a page on HTTP/1.1 after the player element that is
+ * still read, rather than losing the connection by cutting the body short */
+#define DEFAULT_DRAIN_LIMIT	65536L
+
+struct libcda_session * libcda_session_create(void) {
+	struct libcda_session * result = calloc(1, sizeof(struct libcda_session));
+	if(result == NULL) {
+		fprintf(stderr, "libcda_session_create: could not allocate memory for session.\n");
 		return NULL;
 	}
-	user_agent = get_curl_user_agent();
-	curl_easy_setopt(curl, CURLOPT_URL, cda_url);
-	curl_easy_setopt(curl, CURLOPT_USERAGENT, user_agent);
-	curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, write_memory_callback);
-	curl_easy_setopt(curl, CURLOPT_WRITEDATA, chunk);
-	response = curl_easy_perform(curl);
-	curl_easy_cleanup(curl);
-	free(user_agent);
-	if(response != CURLE_OK) {
-		fprintf(stderr, "curl_easy_perform() of URL %s failed: %s\n", cda_url, curl_easy_strerror(response));
+	result->share = curl_share_init();
+	result->multi = curl_multi_init();
+	result->user_agent = get_curl_user_agent();
+	result->drain_limit = DEFAULT_DRAIN_LIMIT;
+	if(result->share == NULL || result->multi == NULL || result->user_agent == NULL) {
+		fprintf(stderr, "libcda_session_create: could not initialize HTTP engine.\n");
+		libcda_session_destroy(result);
+		return NULL;
 	}
-	return chunk;
+	curl_share_setopt(result->share, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+	curl_share_setopt(result->share, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+	curl_share_setopt(result->share, CURLSHOPT_SHARE, CURL_LOCK_DATA_CONNECT);
+	curl_multi_setopt(result->multi, CURLMOPT_PIPELINING, session_pipelining(result));
+	return result;
+}
+
+static struct libcda_session * get_default_session(void);
+
+/* Values are passed as long, like curl_easy_setopt wants them, except for
+ * objects, which are passed as pointers. A NULL session stands for the one
+ * libcda_get_url and libcda_get_urls use in the calling thread. */
+int libcda_session_setopt(struct libcda_session * session, const int option, ...) {
+	va_list arguments;
+	long value = 0;
+	int result = 0;
+	if(session == NULL) session = get_default_session();
+	if(session == NULL) return 1;
+	va_start(arguments, option);
+	switch(option) {
+		case LIBCDA_OPT_CACHE:
+			session->cache = va_arg(arguments, struct libcda_cache *);
+			break;
+		case LIBCDA_OPT_DISK_CACHE:
+			session->disk_cache = va_arg(arguments, struct libcda_disk_cache *);
+			break;
+		case LIBCDA_OPT_JSON_PARSER:
+			value = va_arg(arguments, long);
+			if(value == LIBCDA_JSON_PARSER_LAZY || value == LIBCDA_JSON_PARSER_JSON_C) session->json_parser = value;
+			else result = 1;
+			break;
+		case LIBCDA_OPT_HTTP2:
+			value = va_arg(arguments, long);
+			if(value == 0L || value == 1L) {
+				session->http2 = value;
+				curl_multi_setopt(session->multi, CURLMOPT_PIPELINING, session_pipelining(session));
+			} else result = 1;
+			break;
+		case LIBCDA_OPT_COMPRESSION:
+			value = va_arg(arguments, long);
+			if(value == 0L || value == 1L) session->compression = value;
+			else result = 1;
+			break;
+		case LIBCDA_OPT_DRAIN_LIMIT:
+			value = va_arg(arguments, long);
+			if(value >= 0L) session->drain_limit = value;
+			else result = 1;
+			break;
+		default:
+			result = 1;
+	}
+	va_end(arguments);
+	if(result) fprintf(stderr, "libcda_session_setopt: option %d cannot be set like that.\n", option);
+	return result;
+}
+
+static void add_stats(struct libcda_stats * total, const struct libcda_stats * part) {
+	total->resolves += part->resolves;
+	total->cache_hits += part->cache_hits;
+	total->fetches += part->fetches;
+	total->quality_fetches += part->quality_fetches;
+	total->bytes_downloaded += part->bytes_downloaded;
+	total->bytes_decoded += part->bytes_decoded;
+	total->dns_time += part->dns_time;
+	total->connect_time += part->connect_time;
+	total->tls_time += part->tls_time;
+	total->first_byte_time += part->first_byte_time;
+	total->fetch_time += part->fetch_time;
+	if(total->slowest_fetch_time < part->slowest_fetch_time) total->slowest_fetch_time = part->slowest_fetch_time;
+	total->html_time += part->html_time;
+	total->json_time += part->json_time;
+	total->decode_time += part->decode_time;
+	total->resolve_time += part->resolve_time;
+}
+
+/* Sums over every resolve the session did so far. */
+void libcda_session_get_stats(struct libcda_session * session, struct libcda_stats * stats) {
+	if(session == NULL) session = get_default_session();
+	if(session == NULL) memset(stats, 0, sizeof(struct libcda_stats));
+	else *stats = session->stats;
+}
+
+static void release_global_state(void) {
+	if(!global_init_count) xmlCleanupParser();
+	curl_global_cleanup();
+}
+
+static void destroy_default_session(void * session) {
+	if(session == NULL) return;
+	libcda_session_destroy((struct libcda_session *)session);
+	pthread_mutex_lock(&global_lock);
+	--live_default_sessions;
+	while(!live_default_sessions && deferred_global_cleanups) {
+		--deferred_global_cleanups;
+		release_global_state();
+	}
+	pthread_mutex_unlock(&global_lock);
+}
+
+static void create_default_session_key(void) {
+	pthread_key_create(&default_session_key, destroy_default_session);
+}
+
+/* Sets up curl and libxml2 once for the whole process. Like their own
+ * global setup, this is to be called before any other thread uses libcda,
+ * and not at the same time as libcda_global_cleanup. Nothing global is
+ * torn down while pages are being resolved. */
+int libcda_global_init(void) {
+	if(curl_global_init(CURL_GLOBAL_ALL)) {
+		fprintf(stderr, "libcda_global_init: could not initialize HTTP engine.\n");
+		return 1;
+	}
+	xmlInitParser();
+	pthread_once(&default_session_once, create_default_session_key);
+	pthread_mutex_lock(&global_lock);
+	++global_init_count;
+	pthread_mutex_unlock(&global_lock);
+	return 0;
+}
+
+/* Destroys the default session of the calling thread. What
+ * libcda_global_init set up is released by the cleanup that balances it,
+ * or, while other threads still have default sessions, once the last of
+ * those threads has exited. */
+void libcda_global_cleanup(void) {
+	pthread_once(&default_session_once, create_default_session_key);
+	destroy_default_session(pthread_getspecific(default_session_key));
+	pthread_setspecific(default_session_key, NULL);
+	pthread_mutex_lock(&global_lock);
+	if(global_init_count) {
+		--global_init_count;
+		if(live_default_sessions) ++deferred_global_cleanups;
+		else release_global_state();
+	}
+	pthread_mutex_unlock(&global_lock);
+}
+
+static struct libcda_session * get_default_session(void) {
+	struct libcda_session * result = NULL;
+	pthread_once(&default_session_once, create_default_session_key);
+	result = pthread_getspecific(default_session_key);
+	if(result == NULL) {
+		result = libcda_session_create();
+		if(result != NULL && pthread_setspecific(default_session_key, result)) {
+			libcda_session_destroy(result);
+			result = NULL;
+		}
+		if(result != NULL) {
+			pthread_mutex_lock(&global_lock);
+			++live_default_sessions;
+			pthread_mutex_unlock(&global_lock);
+		}
+	}
+	return result;
+}
+
+/* Hands out an idle handle of the session, or a fresh one if there is none.
+ * Handles go back with release_curl_handle and keep their connections.
+ * With HTTP/2 a transfer waits for a connection that is still being set up
+ * rather than opening its own, so the pages of a video share one. Without
+ * it the handle sticks to HTTP/1.1, which newer curl would not do on its
+ * own. An empty encoding accepts every compression curl was built with. */
+CURL * acquire_curl_handle(struct libcda_session * session, const char * cda_url, curl_write_callback write_callback, void * write_data) {
+	CURL * result = NULL;
+	if(session->idle_count) {
+		result = session->idle_handles[--session->idle_count];
+		curl_easy_reset(result);
+	} else {
+		result = curl_easy_init();
+		if(result == NULL) return NULL;
+	}
+	curl_easy_setopt(result, CURLOPT_SHARE, session->share);
+	curl_easy_setopt(result, CURLOPT_URL, cda_url);
+	curl_easy_setopt(result, CURLOPT_USERAGENT, session->user_agent);
+	if(session->http2) {
+		curl_easy_setopt(result, CURLOPT_HTTP_VERSION, (long)CURL_HTTP_VERSION_2TLS);
+		curl_easy_setopt(result, CURLOPT_PIPEWAIT, 1L);
+	} else {
+		curl_easy_setopt(result, CURLOPT_HTTP_VERSION, (long)CURL_HTTP_VERSION_1_1);
+	}
+	if(session->compression) curl_easy_setopt(result, CURLOPT_ACCEPT_ENCODING, "");
+	curl_easy_setopt(result, CURLOPT_WRITEFUNCTION, write_callback);
+	curl_easy_setopt(result, CURLOPT_WRITEDATA, write_data);
+	return result;
+}
+
+void release_curl_handle(struct libcda_session * session, CURL * curl) {
+	CURL ** bigger = NULL;
+	size_t new_capacity = 0;
+	if(session->idle_count == session->idle_capacity) {
+		new_capacity = (session->idle_capacity << 1) + 4;
+		bigger = realloc(session->idle_handles, new_capacity * sizeof(CURL *));
+		if(bigger == NULL) {
+			curl_easy_cleanup(curl);
+			return;
+		}
+		session->idle_handles = bigger;
+		session->idle_capacity = new_capacity;
+	}
+	session->idle_handles[session->idle_count++] = curl;
 }
 
 static char ensure_last_2bytes_are_hex(const char * bytes) {
@@ -181,464 +641,1827 @@ static char * get_video_id(const char * full_url) {
 	return result;
 }
 
-__attribute__((no_stack_protector, optimize("Os"))) static xmlChar * generate_xpath_query(const char * video_id) {
-	static const char beginning[23] = "//div[@id='mediaplayer";
-	static const size_t beginning_length = 22;
-	static const char ending[3] = "']";
-	static const size_t ending_length = 2;
+/* The id attribute of the element that holds player_data */
+char * get_player_id(const char * video_id) {
+	static const char beginning[12] = "mediaplayer";
+	static const size_t beginning_length = 11;
+	const size_t video_id_length = strlen(video_id);
+	char * result = malloc(beginning_length + video_id_length + 1);
+	if(result != NULL) {
+		memcpy(result, beginning, beginning_length);
+		memcpy(result + beginning_length, video_id, video_id_length + 1);
+	}
+	return result;
+}
 
-	xmlChar * terminate_this;
-	xmlChar terminator_prison[1];
+/* Results that are already resolved, keyed by video ID and quality, where
+ * an empty quality stands for all of them. Entries hold a packed copy of the
+ * results, leave after ttl milliseconds and make room for new ones from the
+ * least recently used end. One cache may serve any number of sessions and
+ * threads; a mutex guards it, as a hit takes well under a microsecond. */
+struct libcda_cache_entry {
+	struct libcda_cache_entry * chain;
+	struct libcda_cache_entry * newer;
+	struct libcda_cache_entry * older;
+	struct cda_results * results;
+	size_t results_size;
+	uint64_t expiry;
+	uint64_t hash;
+	size_t key_length;
+	char key[];
+};
 
-	const size_t video_id_length = strlen(video_id);
-	const size_t total_length = beginning_length + video_id_length + ending_length;
+struct libcda_cache {
+	pthread_mutex_t lock;
+	struct libcda_cache_entry ** buckets;
+	struct libcda_cache_entry * newest;
+	struct libcda_cache_entry * oldest;
+	size_t bucket_mask;
+	size_t max_entries;
+	uint64_t ttl;
+	struct libcda_cache_stats stats;
+};
 
-	xmlChar * result = malloc(total_length + 1);
-	const size_t malloc_status = -(result != NULL);
-	const size_t proxy_bl = (beginning_length & malloc_status)|(0 & ~malloc_status);
-	const size_t proxy_el = (ending_length & malloc_status)|(0 & ~malloc_status);
-	const size_t proxy_vl = (video_id_length & malloc_status)|(0 & ~malloc_status);
+static uint64_t monotonic_nanoseconds(void) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
 
-	memcpy(result, beginning, proxy_bl);
-	memcpy(result + proxy_bl, video_id, proxy_vl);
-	memcpy(result + proxy_bl + proxy_vl, ending, proxy_el);
-	terminate_this = (xmlChar *)(((size_t)(result + total_length) & malloc_status)|((size_t)terminator_prison & ~malloc_status));
-	*terminate_this = '\0';
+/* FNV-1a */
+static uint64_t hash_bytes(const char * bytes, const size_t length) {
+	uint64_t result = 0xCBF29CE484222325;
+	size_t counter = 0;
+	for(; counter < length; ++counter) result = (result ^ (unsigned char)bytes[counter]) * 0x100000001B3;
 	return result;
 }
 
-static char * extract_raw_json_from_html(const char * video_id, const char * html_page, const size_t html_page_length) {
-	static const xmlChar attr_name[12] = "player_data";
-	htmlDocPtr document = NULL;
-	xmlXPathContextPtr context = NULL;
-	xmlXPathObjectPtr xpath_result = NULL;
-	xmlNode * node = NULL;
-	xmlChar * result_object = NULL;
-	xmlChar * xpath_query = NULL;
-	char * result = NULL;
-	size_t length = 0;
-
-	xpath_query = generate_xpath_query(video_id);
-	if(xpath_query == NULL) {
-		fprintf(stderr, "extract_raw_json_from_html: failed to generate xpath_query.\n");
+/* A packed result points nowhere outside its own block, so copying it only
+ * takes moving its pointers along with it. */
+static struct cda_results * copy_results(const struct cda_results * i, const size_t size) {
+	struct cda_results * result = malloc(size);
+	const ptrdiff_t shift = (char *)result - (const char *)i;
+	size_t counter = 0;
+	if(result == NULL) {
+		fprintf(stderr, "copy_results: could not allocate %zu bytes.\n", size);
 		return NULL;
 	}
-
-	document = htmlReadMemory(html_page, html_page_length, NULL, NULL, HTML_PARSE_NOERROR | HTML_PARSE_NOWARNING);
-	if(document == NULL) {
-		fprintf(stderr, "extract_raw_json_from_html: failed to parse HTML from memory.\n");
-		free(xpath_query);
-		return NULL;
+	memcpy(result, i, size);
+	result->quality = (char **)((char *)i->quality + shift);
+	result->url = (char **)((char *)i->url + shift);
+	for(counter = 0; counter < result->quality_count; ++counter) result->quality[counter] += shift;
+	for(counter = 0; counter < result->url_count; ++counter) {
+		if(result->url[counter] != NULL) result->url[counter] += shift;
 	}
+	return result;
+}
 
-	context = xmlXPathNewContext(document);
-	if(context == NULL) {
-		fprintf(stderr, "extract_raw_json_from_html: failed to create new XPath context.\n");
-		xmlFreeDoc(document);
-		free(xpath_query);
+/* ttl of 0 or less keeps entries until they get pushed out */
+struct libcda_cache * libcda_cache_create(const size_t max_entries, const long ttl) {
+	struct libcda_cache * result = NULL;
+	size_t bucket_count = 16;
+	if(!max_entries) {
+		fprintf(stderr, "libcda_cache_create: a cache needs room for at least one entry.\n");
 		return NULL;
 	}
-
-	xpath_result = xmlXPathEval(xpath_query, context);
-	if(xpath_result == NULL) {
-		fprintf(stderr,"extract_raw_json_from_html: unable to evaluate XPath expression %s\n", xpath_query);
-		xmlXPathFreeContext(context);
-		xmlFreeDoc(document);
-		xmlCleanupParser();
-		free(xpath_query);
+	while(bucket_count < max_entries) bucket_count <<= 1;
+	result = calloc(1, sizeof(struct libcda_cache));
+	if(result != NULL) result->buckets = calloc(bucket_count, sizeof(struct libcda_cache_entry *));
+	if(result == NULL || result->buckets == NULL) {
+		fprintf(stderr, "libcda_cache_create: could not allocate memory for %zu entries.\n", max_entries);
+		free(result);
 		return NULL;
 	}
+	pthread_mutex_init(&(result->lock), NULL);
+	result->bucket_mask = bucket_count - 1;
+	result->max_entries = max_entries;
+	result->ttl = ttl > 0 ? (uint64_t)ttl * 1000000 : 0;
+	return result;
+}
 
-	if(!(xpath_result->nodesetval->nodeNr)) {
-		fputs("extract_raw_json_from_html: xmlXPathEval returned 0 results\n", stderr);
-		xmlXPathFreeObject(xpath_result);
-		xmlXPathFreeContext(context);
-		xmlFreeDoc(document);
-		xmlCleanupParser();
-		free(xpath_query);
-		return NULL;
-	}
+static void unlink_cache_entry(struct libcda_cache * cache, struct libcda_cache_entry * entry) {
+	struct libcda_cache_entry ** link = cache->buckets + (entry->hash & cache->bucket_mask);
+	while(*link != entry) link = &((*link)->chain);
+	*link = entry->chain;
+	if(entry->newer != NULL) entry->newer->older = entry->older;
+	else cache->newest = entry->older;
+	if(entry->older != NULL) entry->older->newer = entry->newer;
+	else cache->oldest = entry->newer;
+	--cache->stats.entries;
+}
 
-	node = xpath_result->nodesetval->nodeTab[0];
-	result_object = xmlGetProp(node, attr_name);
-	if(result_object == NULL) {
-		fprintf(stderr,"extract_raw_json_from_html: could not find %s\n", attr_name);
-		xmlXPathFreeObject(xpath_result);
-		xmlXPathFreeContext(context);
-		xmlFreeDoc(document);
-		xmlCleanupParser();
-		free(xpath_query);
-		return NULL;
+static void free_cache_entry(struct libcda_cache_entry * entry) {
+	free(entry->results);
+	free(entry);
+}
+
+void libcda_cache_destroy(struct libcda_cache * cache) {
+	struct libcda_cache_entry * entry = NULL;
+	if(cache == NULL) return;
+	while((entry = cache->oldest) != NULL) {
+		cache->oldest = entry->newer;
+		free_cache_entry(entry);
 	}
+	pthread_mutex_destroy(&(cache->lock));
+	free(cache->buckets);
+	free(cache);
+}
 
-	length = xmlStrlen(result_object);
-	result = malloc(length + 1);
+void libcda_cache_get_stats(struct libcda_cache * cache, struct libcda_cache_stats * stats) {
+	pthread_mutex_lock(&(cache->lock));
+	*stats = cache->stats;
+	pthread_mutex_unlock(&(cache->lock));
+}
+
+/* video_id, a NUL and quality, so that no two pairs make the same key */
+static char * make_cache_key(const char * video_id, const char * quality, size_t * key_length) {
+	const size_t video_id_length = strlen(video_id);
+	const size_t quality_length = quality != NULL ? strlen(quality) : 0;
+	char * result = malloc(video_id_length + quality_length + 2);
 	if(result == NULL) {
-		fprintf(stderr,"extract_raw_json_from_html: could not allocate memory for result\n");
-		xmlFree(result_object);
-		xmlXPathFreeObject(xpath_result);
-		xmlXPathFreeContext(context);
-		xmlFreeDoc(document);
-		xmlCleanupParser();
-		free(xpath_query);
+		fprintf(stderr, "make_cache_key: could not allocate memory for key.\n");
 		return NULL;
 	}
-	memcpy(result, result_object, length);
-	result[length] = '\0';
-
-	xmlFree(result_object);
-	xmlXPathFreeObject(xpath_result);
-	xmlXPathFreeContext(context);
-	xmlFreeDoc(document);
-	xmlCleanupParser();
-	free(xpath_query);
+	memcpy(result, video_id, video_id_length + 1);
+	if(quality_length) memcpy(result + video_id_length + 1, quality, quality_length);
+	result[video_id_length + quality_length + 1] = '\0';
+	*key_length = video_id_length + quality_length + 1;
 	return result;
 }
 
-static struct json_object * get_big_json(const char * page_url, const char * video_id) {
-	char * raw_json = NULL;
-	struct json_object * result = NULL;
-	struct known_size_memory_region * html_page = NULL;
+/* Must be called with the lock held */
+static struct libcda_cache_entry * find_cache_entry(struct libcda_cache * cache, const char * key, const size_t key_length, const uint64_t hash) {
+	struct libcda_cache_entry * entry = cache->buckets[hash & cache->bucket_mask];
+	while(entry != NULL && (entry->hash != hash || entry->key_length != key_length || memcmp(entry->key, key, key_length))) entry = entry->chain;
+	return entry;
+}
 
-	html_page = http_get_with_curl(page_url);
-	if(html_page == NULL) {
-		fprintf(stderr,"get_big_json: download failed.\n");
-		return NULL;
+static struct cda_results * look_up_results(struct libcda_cache * cache, const char * video_id, const char * quality) {
+	struct libcda_cache_entry * entry = NULL;
+	struct cda_results * result = NULL;
+	size_t key_length = 0;
+	char * key = make_cache_key(video_id, quality, &key_length);
+	uint64_t hash = 0;
+	if(key == NULL) return NULL;
+	hash = hash_bytes(key, key_length);
+
+	pthread_mutex_lock(&(cache->lock));
+	entry = find_cache_entry(cache, key, key_length, hash);
+	if(entry != NULL && cache->ttl && entry->expiry <= monotonic_nanoseconds()) {
+		unlink_cache_entry(cache, entry);
+		free_cache_entry(entry);
+		entry = NULL;
+		++cache->stats.expirations;
 	}
-
-	raw_json = (char *)extract_raw_json_from_html(video_id, html_page->memory, html_page->size);
-	free_memory_chunk(html_page);
-	html_page = NULL;
-
-	if(raw_json == NULL) {
-		fprintf(stderr,"get_big_json: could not find JSON.\n");
-		return NULL;
+	if(entry == NULL) {
+		++cache->stats.misses;
+	} else {
+		++cache->stats.hits;
+		if(entry != cache->newest) {
+			entry->newer->older = entry->older;
+			if(entry->older != NULL) entry->older->newer = entry->newer;
+			else cache->oldest = entry->newer;
+			entry->older = cache->newest;
+			entry->newer = NULL;
+			cache->newest->newer = entry;
+			cache->newest = entry;
+		}
+		result = copy_results(entry->results, entry->results_size);
 	}
+	pthread_mutex_unlock(&(cache->lock));
+	free(key);
+	return result;
+}
 
-	result = json_tokener_parse(raw_json);
-	free(raw_json);
-	if(result == NULL) {
-		fprintf(stderr,"get_big_json: parsing JSON failed.\n");
-		return NULL;
+/* The copy is made before taking the lock and whatever the entry pushes out
+ * is freed after letting go of it, so that other threads only wait for
+ * pointers to be swapped. */
+static void store_results(struct libcda_cache * cache, const char * video_id, const char * quality, const struct cda_results * results) {
+	struct libcda_cache_entry * entry = NULL;
+	struct libcda_cache_entry * old = NULL;
+	struct libcda_cache_entry * dropped = NULL;
+	size_t key_length = 0;
+	char * key = make_cache_key(video_id, quality, &key_length);
+	if(key == NULL) return;
+	entry = malloc(sizeof(struct libcda_cache_entry) + key_length);
+	if(entry != NULL) {
+		entry->results_size = libcda_results_size(results);
+		entry->results = malloc(entry->results_size);
+		if(entry->results == NULL) {
+			free(entry);
+			entry = NULL;
+		}
+	}
+	if(entry == NULL) {
+		fprintf(stderr, "store_results: could not allocate memory for cache entry.\n");
+		free(key);
+		return;
 	}
+	libcda_results_pack(results, entry->results, entry->results_size);
+	memcpy(entry->key, key, key_length);
+	free(key);
+	entry->key_length = key_length;
+	entry->hash = hash_bytes(entry->key, key_length);
+	entry->expiry = cache->ttl ? monotonic_nanoseconds() + cache->ttl : 0;
+	entry->newer = NULL;
+
+	pthread_mutex_lock(&(cache->lock));
+	old = find_cache_entry(cache, entry->key, key_length, entry->hash);
+	if(old != NULL) {
+		unlink_cache_entry(cache, old);
+		old->chain = dropped;
+		dropped = old;
+	}
+	entry->chain = cache->buckets[entry->hash & cache->bucket_mask];
+	cache->buckets[entry->hash & cache->bucket_mask] = entry;
+	entry->older = cache->newest;
+	if(cache->newest != NULL) cache->newest->newer = entry;
+	else cache->oldest = entry;
+	cache->newest = entry;
+	++cache->stats.entries;
+	++cache->stats.insertions;
+	while(cache->stats.entries > cache->max_entries) {
+		old = cache->oldest;
+		unlink_cache_entry(cache, old);
+		old->chain = dropped;
+		dropped = old;
+		++cache->stats.evictions;
+	}
+	pthread_mutex_unlock(&(cache->lock));
+	while(dropped != NULL) {
+		old = dropped;
+		dropped = old->chain;
+		free_cache_entry(old);
+	}
+}
 
+struct cda_results * libcda_cache_lookup(struct libcda_cache * cache, const char * cda_page_url, const char * quality) {
+	struct cda_results * result = NULL;
+	char * video_id = get_video_id(cda_page_url);
+	if(video_id == NULL) return NULL;
+	result = look_up_results(cache, video_id, quality);
+	free(video_id);
 	return result;
 }
 
-__attribute__((no_stack_protector)) static char determine_json_type(struct json_object * small_json) {
-	struct json_object * jsonic_crosshair;
-	char result;
-	char is_m3u8;
-	char is_file;
-	json_object_object_get_ex(small_json, "file", &jsonic_crosshair);
-	is_file = !!json_object_get_string_len(jsonic_crosshair);
+/* The same idea in a file, so that processes share results and they outlive
+ * them: a header, then a fixed number of fixed-size slots that the file is
+ * mapped onto. A key goes into the first fitting slot of the DISK_CACHE_PROBE
+ * ones its hash points at, and in there the key is followed by the quality
+ * count, the url count and every quality and url with its NUL.
+ * Nothing is ever locked. Every slot has a sequence number that is odd while
+ * someone writes to it: writers claim a slot by making it odd with a compare
+ * and swap and skip slots they can't claim, readers copy what they need and
+ * start over if the number changed in the meantime. A claim carries the pid
+ * of the writer, and the writer notes when it started, so that a slot whose
+ * writer died or hangs halfway can be claimed again rather than stay odd
+ * forever. Processes sharing a file are taken to see each other's pids.
+ * Times are kept in wall clock milliseconds, as they have to mean the same
+ * to every process. The layout is in get_url_internal.h. */
+
+static int64_t wall_clock_milliseconds(void) {
+	struct timespec now;
+	clock_gettime(CLOCK_REALTIME, &now);
+	return (int64_t)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
 
-	json_object_object_get_ex(small_json, "manifest_apple", &jsonic_crosshair);
-	is_m3u8 = !!json_object_get_string_len(jsonic_crosshair);
+/* Whether the write sequence, odd, stands for is past waiting for. The
+ * start time only counts once the writer noted it for this very claim. */
+static int disk_cache_write_is_stale(struct disk_cache_slot * slot, const uint64_t sequence, const int64_t now) {
+	const pid_t writer = DISK_CACHE_WRITER(sequence);
+	if(writer <= 0 || (kill(writer, 0) && errno == ESRCH)) return 1;
+	if(__atomic_load_n(&(slot->started_for), __ATOMIC_ACQUIRE) != (uint32_t)sequence) return 0;
+	return now - __atomic_load_n(&(slot->write_started), __ATOMIC_RELAXED) > DISK_CACHE_STALE_WRITE;
+}
 
-	result = (is_file ^ is_m3u8) * (is_file | (is_m3u8 << 1));
-	return result;
+/* Makes the sequence of slot odd, with the pid of this process in its upper
+ * half, and puts the claim in *claimed. A slot that is already odd is only
+ * taken over from a stale writer. */
+static int claim_disk_cache_slot(struct disk_cache_slot * slot, const int64_t now, uint64_t * claimed) {
+	uint64_t sequence = __atomic_load_n(&(slot->sequence), __ATOMIC_ACQUIRE);
+	if((sequence & 1) && !disk_cache_write_is_stale(slot, sequence, now)) return 1;
+	*claimed = ((uint64_t)getpid() << 32) | (uint32_t)(sequence + 1 + (sequence & 1));
+	if(!__atomic_compare_exchange_n(&(slot->sequence), &sequence, *claimed, 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) return 1;
+	__atomic_store_n(&(slot->write_started), now, __ATOMIC_RELAXED);
+	__atomic_store_n(&(slot->started_for), (uint32_t)*claimed, __ATOMIC_RELEASE);
+	return 0;
 }
 
-__attribute__((no_stack_protector)) static struct json_object * find_small_json(struct json_object * big_json) {
-	static const char bad_message[48] = "find_small_json: JSON has no video dictionary.\n";
-	static const char good_message[1] = {0};
-	struct json_object * result = NULL;
-	size_t good = -json_object_object_get_ex(big_json, "video", &result);
-	char * actual_message = (char *)(((size_t)good_message & good)|((size_t)bad_message & ~good));
-	(void)fputs(actual_message, stderr);
+/* A file that doesn't exist yet or is empty gets slot_count slots; one that
+ * exists keeps the slots it has. ttl of 0 or less keeps entries until they
+ * get pushed out. */
+struct libcda_disk_cache * libcda_disk_cache_open(const char * path, const size_t slot_count, const long ttl) {
+	struct libcda_disk_cache * result = NULL;
+	struct disk_cache_header header = {DISK_CACHE_MAGIC, DISK_CACHE_SLOT_SIZE, 0, {0}};
+	struct stat file_status;
+	void * mapping = MAP_FAILED;
+	size_t size = 0;
+	int fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+	if(fd < 0) {
+		fprintf(stderr, "libcda_disk_cache_open: could not open %s: %s\n", path, strerror(errno));
+		return NULL;
+	}
+/* Only setting the file up takes a lock, so that two processes starting at
+ * once don't both do it. */
+	flock(fd, LOCK_EX);
+	if(fstat(fd, &file_status)) {
+		fprintf(stderr, "libcda_disk_cache_open: could not look at %s: %s\n", path, strerror(errno));
+	} else if(!file_status.st_size) {
+		header.slot_count = slot_count;
+		size = sizeof(struct disk_cache_header) + slot_count * sizeof(struct disk_cache_slot);
+		if(!slot_count || slot_count > UINT32_MAX) fprintf(stderr, "libcda_disk_cache_open: cannot make a cache of %zu slots.\n", slot_count);
+		else if(ftruncate(fd, size) || pwrite(fd, &header, sizeof(struct disk_cache_header), 0) != sizeof(struct disk_cache_header)) fprintf(stderr, "libcda_disk_cache_open: could not set up %s: %s\n", path, strerror(errno));
+		else mapping = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	} else if((size_t)file_status.st_size < sizeof(struct disk_cache_header) || pread(fd, &header, sizeof(struct disk_cache_header), 0) != sizeof(struct disk_cache_header) || memcmp(header.magic, DISK_CACHE_MAGIC, 8) || header.slot_size != DISK_CACHE_SLOT_SIZE || !header.slot_count || (size_t)file_status.st_size != sizeof(struct disk_cache_header) + (size_t)header.slot_count * sizeof(struct disk_cache_slot)) {
+		fprintf(stderr, "libcda_disk_cache_open: %s is not a cache file of this version.\n", path);
+	} else {
+		size = file_status.st_size;
+		mapping = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	}
+	flock(fd, LOCK_UN);
+	close(fd);
+	if(size && mapping == MAP_FAILED) fprintf(stderr, "libcda_disk_cache_open: could not map %s: %s\n", path, strerror(errno));
+	if(mapping == MAP_FAILED) return NULL;
+
+	result = malloc(sizeof(struct libcda_disk_cache));
+	if(result == NULL) {
+		fprintf(stderr, "libcda_disk_cache_open: could not allocate memory for cache.\n");
+		munmap(mapping, size);
+		return NULL;
+	}
+	result->header = mapping;
+	result->slots = (struct disk_cache_slot *)(result->header + 1);
+	result->mapping_size = size;
+	result->slot_count = header.slot_count;
+	result->ttl = ttl > 0 ? ttl : 0;
 	return result;
 }
 
-static char ** count_qualities(struct json_object * video, size_t * count, const char json_type) {
-	static const char ignore_this_quality[5] = "auto";
-	struct json_object * qualities = NULL;
-	char ** result = NULL;
+void libcda_disk_cache_close(struct libcda_disk_cache * cache) {
+	if(cache == NULL) return;
+	munmap(cache->header, cache->mapping_size);
+	free(cache);
+}
+
+/* Rebuilds a packed result out of the payload of a slot, which any process
+ * could have written, so every count is checked against the bytes. */
+static struct cda_results * unpack_disk_cache_payload(const char * payload, const size_t length, const char json_type) {
+	struct cda_results * result = NULL;
+	const char * end = payload + length;
+	char * strings = NULL;
+	char * string = NULL;
+	uint16_t counts[2];
 	size_t counter = 0;
-	size_t emergency_counter = 0;
-	size_t key_length = 0;
-	int bad = 0;
-	int comparison = 0;
-	bad = !json_object_object_get_ex(video, "qualities", &qualities);
-	if(bad) {
-		fprintf(stderr,"count_qualities: video object does not contain qualities dictionary.\n");
-		return result;
-	}
-	*count = json_object_object_length(qualities) - (json_type == LIBCDA_VIDEO_IS_M3U8);
-	if(!(*count)) {
-		fprintf(stderr,"count_qualities: qualities dictionary is empty.\n");
-		return result;
+	if(length < sizeof(counts) || json_type < LIBCDA_VIDEO_IS_FILE || json_type > LIBCDA_VIDEO_IS_M3U8) return NULL;
+	memcpy(counts, payload, sizeof(counts));
+	payload += sizeof(counts);
+	for(string = (char *)payload; string < end && counter < (size_t)counts[0] + counts[1]; ++counter) {
+		string = memchr(string, '\0', end - string);
+		if(string == NULL) return NULL;
+		++string;
 	}
-	result = malloc(*count * sizeof(char *));
+	if(counter != (size_t)counts[0] + counts[1] || string != end) return NULL;
+
+	result = malloc(results_size(counts[0], counts[1], end - payload));
 	if(result == NULL) {
-		fprintf(stderr,"count_qualities: main allocation error.\n");
-		return result;
+		fprintf(stderr, "unpack_disk_cache_payload: could not allocate memory for results.\n");
+		return NULL;
 	}
-	json_object_object_foreach(qualities, key, val) {
-		comparison = strcmp(key, ignore_this_quality);
-		if(comparison != 0) {
-			key_length = strlen(key);
-			result[counter] = malloc(key_length + 1);
-			if(result[counter] == NULL) {
-				fprintf(stderr,"count_qualities: allocation error %zu\n", counter);
-				while(emergency_counter <= counter) free(result[emergency_counter++]);
-				free(result);
-				return NULL;
-			}
-			memcpy(result[counter], key, key_length);
+	strings = lay_out_results(result, counts[0], counts[1], json_type);
+	memcpy(strings, payload, end - payload);
+	for(counter = 0; counter < counts[0]; ++counter, strings += strlen(strings) + 1) result->quality[counter] = strings;
+	for(counter = 0; counter < counts[1]; ++counter, strings += strlen(strings) + 1) result->url[counter] = strings;
+	return result;
+}
 
-			result[counter++][key_length] = '\0';
+struct cda_results * look_up_disk_results(struct libcda_disk_cache * cache, const char * video_id, const char * quality) {
+	struct disk_cache_slot * slot = NULL;
+	struct cda_results * result = NULL;
+	char bytes[sizeof(slot->bytes)];
+	size_t key_length = 0;
+	size_t payload_length = 0;
+	size_t probe = 0;
+	size_t retries = 0;
+	uint64_t hash = 0;
+	uint64_t sequence = 0;
+	int64_t expiry = 0;
+	char json_type = 0;
+	char * key = make_cache_key(video_id, quality, &key_length);
+	if(key == NULL) return NULL;
+	hash = hash_bytes(key, key_length);
+
+	for(probe = 0; probe < DISK_CACHE_PROBE && result == NULL; ++probe) {
+		slot = cache->slots + (hash + probe) % cache->slot_count;
+		for(retries = 0; retries < DISK_CACHE_RETRIES; ++retries) {
+			sequence = __atomic_load_n(&(slot->sequence), __ATOMIC_ACQUIRE);
+			if(sequence & 1) continue;
+			if(__atomic_load_n(&(slot->hash), __ATOMIC_RELAXED) != hash || __atomic_load_n(&(slot->key_length), __ATOMIC_RELAXED) != key_length) break;
+			payload_length = __atomic_load_n(&(slot->payload_length), __ATOMIC_RELAXED);
+			expiry = __atomic_load_n(&(slot->expiry), __ATOMIC_RELAXED);
+			json_type = __atomic_load_n(&(slot->json_type), __ATOMIC_RELAXED);
+			if(key_length + payload_length <= sizeof(bytes)) memcpy(bytes, slot->bytes, key_length + payload_length);
+			__atomic_thread_fence(__ATOMIC_ACQUIRE);
+			if(__atomic_load_n(&(slot->sequence), __ATOMIC_RELAXED) != sequence) continue;
+			if(key_length + payload_length > sizeof(bytes) || memcmp(bytes, key, key_length)) break;
+			if(!expiry || expiry > wall_clock_milliseconds()) result = unpack_disk_cache_payload(bytes + key_length, payload_length, json_type);
+			break;
 		}
 	}
+	free(key);
 	return result;
 }
 
-static const char * translate_succinct_quality_to_resolutional_quality(const char * squality) {
-	static const char * all_known_rqualities[8] = {"144p", "240p", "360p", "480p", "720p", "1080p", "2K",  "4K"};
-	static const char * all_known_squalities[8] = {"144p", "240p", "vl",   "lq",   "sd",   "hd",    "qhd", "uhd"};
-	static const size_t ak_limit = 8;
-	char * result = NULL;
+/* Results that don't fit a slot or have a url missing aren't kept. */
+void store_disk_results(struct libcda_disk_cache * cache, const char * video_id, const char * quality, const struct cda_results * results) {
+	struct disk_cache_slot * slot = NULL;
+	struct disk_cache_slot * victim = NULL;
+	char bytes[sizeof(slot->bytes)];
+	size_t key_length = 0;
+	size_t length = 0;
+	size_t probe = 0;
 	size_t counter = 0;
-	size_t keep_going = 1;
-	while(keep_going) {
-		keep_going = !!strcmp(squality, all_known_squalities[counter]);
-		result = (char *)(((size_t)all_known_rqualities[counter] & -keep_going)|((size_t)result & ~(-keep_going)));
-		keep_going &= (counter++ < ak_limit);
+	uint64_t hash = 0;
+	uint64_t claimed = 0;
+	uint16_t counts[2] = {results->quality_count, results->url_count};
+	int64_t now = wall_clock_milliseconds();
+	int64_t victim_expiry = INT64_MAX;
+	int64_t expiry = 0;
+	char * key = make_cache_key(video_id, quality, &key_length);
+	if(key == NULL) return;
+	hash = hash_bytes(key, key_length);
+
+	if(results->quality_count > UINT16_MAX || results->url_count > UINT16_MAX || key_length + sizeof(counts) > sizeof(bytes)) {
+		free(key);
+		return;
+	}
+	memcpy(bytes, key, key_length);
+	memcpy(bytes + key_length, counts, sizeof(counts));
+	length = key_length + sizeof(counts);
+	free(key);
+	for(counter = 0; counter < results->quality_count + results->url_count; ++counter) {
+		key = counter < results->quality_count ? results->quality[counter] : results->url[counter - results->quality_count];
+		if(key == NULL || length + strlen(key) + 1 > sizeof(bytes)) return;
+		memcpy(bytes + length, key, strlen(key) + 1);
+		length += strlen(key) + 1;
 	}
+
+/* The slot holding this key, an empty or expired one, or else the one that
+ * would expire first */
+	for(probe = 0; probe < DISK_CACHE_PROBE; ++probe) {
+		slot = cache->slots + (hash + probe) % cache->slot_count;
+		expiry = __atomic_load_n(&(slot->expiry), __ATOMIC_RELAXED);
+		if(__atomic_load_n(&(slot->hash), __ATOMIC_RELAXED) == hash || !__atomic_load_n(&(slot->key_length), __ATOMIC_RELAXED) || (expiry && expiry <= now)) {
+			victim = slot;
+			break;
+		}
+		if(expiry && expiry < victim_expiry) {
+			victim = slot;
+			victim_expiry = expiry;
+		}
+	}
+	if(victim == NULL) victim = cache->slots + hash % cache->slot_count;
+
+	if(claim_disk_cache_slot(victim, now, &claimed)) return;
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	__atomic_store_n(&(victim->hash), hash, __ATOMIC_RELAXED);
+	__atomic_store_n(&(victim->key_length), key_length, __ATOMIC_RELAXED);
+	__atomic_store_n(&(victim->payload_length), length - key_length, __ATOMIC_RELAXED);
+	__atomic_store_n(&(victim->json_type), results->json_type, __ATOMIC_RELAXED);
+	__atomic_store_n(&(victim->expiry), cache->ttl ? now + cache->ttl : 0, __ATOMIC_RELAXED);
+	memcpy(victim->bytes, bytes, length);
+/* Fails if the claim was taken over, in which case the new writer commits */
+	__atomic_compare_exchange_n(&(victim->sequence), &claimed, (uint32_t)(claimed + 1), 0, __ATOMIC_RELEASE, __ATOMIC_RELAXED);
+}
+
+struct cda_results * libcda_disk_cache_lookup(struct libcda_disk_cache * cache, const char * cda_page_url, const char * quality) {
+	struct cda_results * result = NULL;
+	char * video_id = get_video_id(cda_page_url);
+	if(video_id == NULL) return NULL;
+	result = look_up_disk_results(cache, video_id, quality);
+	free(video_id);
 	return result;
 }
 
-__attribute__((no_stack_protector)) static const char * get_current_quality(struct json_object * video) {
-	static const char bad_message0[82] = "get_current_quality: video object has no quality string.\n";
-	static const char bad_message1[55] = "get_current_quality: could not obtain quality string.\n";
-	static const char null_message[1] = {0};
-	char * print_this;
+__attribute__((no_stack_protector, optimize("Os"))) static xmlChar * generate_xpath_query(const char * video_id) {
+	static const char beginning[23] = "//div[@id='mediaplayer";
+	static const size_t beginning_length = 22;
+	static const char ending[3] = "']";
+	static const size_t ending_length = 2;
 
-	struct json_object * quality = NULL;
-	const char * result_reference = NULL;
-	const char * result = NULL;
+	xmlChar * terminate_this;
+	xmlChar terminator_prison[1];
 
-	size_t test = -json_object_object_get_ex(video, "quality", &quality);
-	print_this = (char *)(((size_t)null_message & test)|((size_t)bad_message0 & ~test));
-	fputs(print_this, stderr);
+	const size_t video_id_length = strlen(video_id);
+	const size_t total_length = beginning_length + video_id_length + ending_length;
 
-	result_reference = json_object_get_string(quality);
-	test = -(result_reference != NULL);
-	print_this = (char *)(((size_t)null_message & test)|((size_t)bad_message1 & ~test));
-	fputs(print_this, stderr);
+	xmlChar * result = malloc(total_length + 1);
+	const size_t malloc_status = -(result != NULL);
+	const size_t proxy_bl = (beginning_length & malloc_status)|(0 & ~malloc_status);
+	const size_t proxy_el = (ending_length & malloc_status)|(0 & ~malloc_status);
+	const size_t proxy_vl = (video_id_length & malloc_status)|(0 & ~malloc_status);
 
-	result = translate_succinct_quality_to_resolutional_quality(result_reference);
+	memcpy(result, beginning, proxy_bl);
+	memcpy(result + proxy_bl, video_id, proxy_vl);
+	memcpy(result + proxy_bl + proxy_vl, ending, proxy_el);
+	terminate_this = (xmlChar *)(((size_t)(result + total_length) & malloc_status)|((size_t)terminator_prison & ~malloc_status));
+	*terminate_this = '\0';
 	return result;
 }
 
-static size_t determine_quality_index(char ** known_qualities, const size_t limit, const char * quality) {
-	size_t counter = 0;
-	char keep_going = 1;
-	while(counter < limit && keep_going) keep_going = !!strcmp(known_qualities[counter++], quality);
-	return counter;
-}
+char * extract_raw_json_with_libxml2(const char * video_id, const char * html_page, const size_t html_page_length) {
+	static const xmlChar attr_name[12] = "player_data";
+	htmlDocPtr document = NULL;
+	xmlXPathContextPtr context = NULL;
+	xmlXPathObjectPtr xpath_result = NULL;
+	xmlNode * node = NULL;
+	xmlChar * result_object = NULL;
+	xmlChar * xpath_query = NULL;
+	char * result = NULL;
+	size_t length = 0;
 
-static size_t remove_certain_words(char * input_string) {
-// 8th word: .cda.mp4
-	static char * removable_word[] = {"_XDDD", "_CDA", "_ADC", "_CXD", "_QWE", "_Q5", "_IKSDE", "%5D452%5D%3EAc"};
-	static size_t removable_word_count = 8;
-	static size_t removable_word_length[8] = {5, 4, 4, 4, 4, 3, 6, 14};
-	size_t saved_bytes = 0;
-	size_t current_word = 0;
-	char * pos = NULL;
-	for(; current_word < removable_word_count; ++current_word) {
-		while ((pos = strstr(input_string, removable_word[current_word])) != NULL) {
-			memmove(pos, pos + removable_word_length[current_word], strlen(pos + removable_word_length[current_word]) + 1);
-			saved_bytes += removable_word_length[current_word];
-		}
+	xpath_query = generate_xpath_query(video_id);
+	if(xpath_query == NULL) {
+		fprintf(stderr, "extract_raw_json_with_libxml2: failed to generate xpath_query.\n");
+		return NULL;
 	}
-	return saved_bytes;
-}
 
-static size_t replace_certain_words(char * input_string) {
-// 1st word: .2cda.pl
-// 2nd word: .3cda.pl
-// new word: .cda.pl
-	static const char * replace_this_word[] = {"%5Da452%5DA%3D", "%5Db452%5DA%3D"};
-	static const size_t replace_this_word_length[2] = {14, 14};
-	static const size_t replace_this_word_count = 2;
-	static const char new_word[] = "%5D452%5DA%3D";
-	static const size_t new_word_length = 13;
-	size_t counter = 0;
-	size_t saved_bytes = 0;
-	char * pos = NULL;
-	char * cur = NULL;
-	for(; counter < replace_this_word_count; ++counter) {
-		pos = input_string;
-		while ((pos = strstr(pos, replace_this_word[counter])) != NULL) {
-			if (new_word_length != replace_this_word_length[counter]) {
-				cur = pos + replace_this_word_length[counter];
-				memmove(pos + new_word_length, cur, strlen(cur) + 1);
-				saved_bytes += (replace_this_word_length[counter] - new_word_length);
-			}
-			memcpy(pos, new_word, new_word_length);
-			pos += new_word_length;
-		}
+	document = htmlReadMemory(html_page, html_page_length, NULL, NULL, HTML_PARSE_NOERROR | HTML_PARSE_NOWARNING);
+	if(document == NULL) {
+		fprintf(stderr, "extract_raw_json_with_libxml2: failed to parse HTML from memory.\n");
+		free(xpath_query);
+		return NULL;
 	}
-	return saved_bytes;
-}
 
+	context = xmlXPathNewContext(document);
+	if(context == NULL) {
+		fprintf(stderr, "extract_raw_json_with_libxml2: failed to create new XPath context.\n");
+		xmlFreeDoc(document);
+		free(xpath_query);
+		return NULL;
+	}
 
+	xpath_result = xmlXPathEval(xpath_query, context);
+	if(xpath_result == NULL) {
+		fprintf(stderr,"extract_raw_json_with_libxml2: unable to evaluate XPath expression %s\n", xpath_query);
+		xmlXPathFreeContext(context);
+		xmlFreeDoc(document);
+		free(xpath_query);
+		return NULL;
+	}
 
-static size_t unquote(char * string, const size_t length) {
-	short int prison = 0x3030;
-	char * buf;
-	size_t read_counter = 0;
-	size_t write_counter = 0;
-	size_t percent_detected;
-	size_t result = 0;
-	size_t increase;
-	char c;
-	while(read_counter < length) {
-		c = string[read_counter++];
-		percent_detected = -(c == '%');
-		increase = percent_detected & 2;
-		buf = (char *)(
-			(
-				(size_t)(string + read_counter) & percent_detected
-			)|(
-				(size_t)(&prison) & ~percent_detected
-			)
-		);
-		c = (((((buf[0] & 0xF) + (buf[0] >> 6) * 9) << 4) | ((buf[1] & 0xF) + (buf[1] >> 6) * 9)) & percent_detected) | (c & ~percent_detected);
-		read_counter += increase;
-		result += increase;
-		string[write_counter++] = c;
-	}
-	return result;
-}
-
-#if defined(__i386__)
-#	if defined(__AVX512F__) && defined(__AVX512BW__)
-#		include "avx512/decode_url.c"
-#	elif defined(__AVX2__)
-#		include "avx2/decode_url.c"
-#	elif defined(__SSE2__)
-#		include "sse2/decode_url.c"
-#	elif defined(__MMX__)
-#		include "mmx/decode_url.c"
-#	else
-#		include "generic/decode_url.c"
-#	endif
-#elif defined(__amd64__)
-#	if defined(__AVX512F__) && defined(__AVX512BW__)
-#		include "avx512/decode_url.c"
-#	elif defined(__AVX2__)
-#		include "avx2/decode_url.c"
-#	else
-#		include "sse2/decode_url.c"
-#	endif
-#else
-#	include "generic/decode_url.c"
-#endif
+	if(!(xpath_result->nodesetval->nodeNr)) {
+		fputs("extract_raw_json_with_libxml2: xmlXPathEval returned 0 results\n", stderr);
+		xmlXPathFreeObject(xpath_result);
+		xmlXPathFreeContext(context);
+		xmlFreeDoc(document);
+		free(xpath_query);
+		return NULL;
+	}
 
-static char * decode_url(const char * encoded_url, const size_t length) {
-	static char protocol[9] = "https://";
-	static char extension[5] = ".mp4";
-	char * result = NULL;
-	void * intermediate = NULL;
-	size_t remove_that_many_bytes = 0;
-	size_t actionable_length = length;
+	node = xpath_result->nodesetval->nodeTab[0];
+	result_object = xmlGetProp(node, attr_name);
+	if(result_object == NULL) {
+		fprintf(stderr,"extract_raw_json_with_libxml2: could not find %s\n", attr_name);
+		xmlXPathFreeObject(xpath_result);
+		xmlXPathFreeContext(context);
+		xmlFreeDoc(document);
+		free(xpath_query);
+		return NULL;
+	}
 
-// For debugging
-//	printf("Decoding URL[%zu]: %s\n", length, encoded_url);
-#if defined(LIBCDA_URL_DECODING_IS_OPTIMIZED)
-	size_t size_for_simd = (length + ALIGNMENT_MASK) & (~ALIGNMENT_MASK);
+	length = xmlStrlen(result_object);
+	result = malloc(length + 1);
+	if(result == NULL) {
+		fprintf(stderr,"extract_raw_json_with_libxml2: could not allocate memory for result\n");
+		xmlFree(result_object);
+		xmlXPathFreeObject(xpath_result);
+		xmlXPathFreeContext(context);
+		xmlFreeDoc(document);
+		free(xpath_query);
+		return NULL;
+	}
+	memcpy(result, result_object, length);
+	result[length] = '\0';
 
-	intermediate = aligned_alloc(ALIGNMENT, size_for_simd + 1);
-#else
-	intermediate = malloc(length + 1);
-#endif
+	xmlFree(result_object);
+	xmlXPathFreeObject(xpath_result);
+	xmlXPathFreeContext(context);
+	xmlFreeDoc(document);
+	free(xpath_query);
+	return result;
+}
 
-	memcpy(intermediate, encoded_url, length);
-	((char *)intermediate)[length] = '\0';
-	
-	remove_that_many_bytes += remove_certain_words(intermediate);
-	remove_that_many_bytes += replace_certain_words(intermediate);
-	actionable_length -= remove_that_many_bytes;
+/* Appends code_point to output as UTF-8, the way libxml2 would store it */
+static size_t put_utf8(char * output, const unsigned long code_point) {
+	if(code_point < 0x80) {
+		output[0] = code_point;
+		return 1;
+	}
+	if(code_point < 0x800) {
+		output[0] = 0xC0 | (code_point >> 6);
+		output[1] = 0x80 | (code_point & 0x3F);
+		return 2;
+	}
+	if(code_point < 0x10000) {
+		output[0] = 0xE0 | (code_point >> 12);
+		output[1] = 0x80 | ((code_point >> 6) & 0x3F);
+		output[2] = 0x80 | (code_point & 0x3F);
+		return 3;
+	}
+	output[0] = 0xF0 | (code_point >> 18);
+	output[1] = 0x80 | ((code_point >> 12) & 0x3F);
+	output[2] = 0x80 | ((code_point >> 6) & 0x3F);
+	output[3] = 0x80 | (code_point & 0x3F);
+	return 4;
+}
 
-	remove_that_many_bytes += unquote(intermediate, actionable_length);
-	actionable_length = length - remove_that_many_bytes;
+/* Decodes the character references player_data is known to use. Anything
+ * more exotic returns NULL and is left to libxml2. No reference is shorter
+ * than its decoded form, so length + 1 bytes are always enough. */
+char * decode_html_entities(const char * value, const size_t length) {
+	static const char * named_entity[5] = {"quot;", "amp;", "lt;", "gt;", "apos;"};
+	static const size_t named_entity_length[5] = {5, 4, 3, 3, 5};
+	static const char named_entity_value[5] = {'"', '&', '<', '>', '\''};
+	static const size_t named_entity_count = 5;
+	const char * read = value;
+	const char * end = value + length;
+	const char * ampersand = NULL;
+	char * digits_end = NULL;
+	char * result = malloc(length + 1);
+	char * write = result;
+	unsigned long code_point = 0;
+	size_t counter = 0;
 
-	weird_decoding_ritual(intermediate, actionable_length);
+	if(result == NULL) {
+		fprintf(stderr, "decode_html_entities: could not allocate memory for result.\n");
+		return NULL;
+	}
 
-	result = malloc(actionable_length + 13);
-	memcpy(result, protocol, 8);
-	memcpy(result + 8, intermediate, actionable_length);
-	memcpy(result + 8 + actionable_length, extension, 4);
-	result[actionable_length + 12] = '\0';
-	free(intermediate);
+	while((ampersand = memchr(read, '&', end - read)) != NULL) {
+		memcpy(write, read, ampersand - read);
+		write += ampersand - read;
+		read = ampersand + 1;
+
+		if(read < end && *read == '#') {
+			++read;
+			errno = 0;
+/* strtoul would take leading spaces and a sign too, which libxml2 does not */
+			digits_end = (char *)read;
+			if(read < end && (*read == 'x' || *read == 'X')) {
+				++read;
+				digits_end = (char *)read;
+				if(read < end && isxdigit((unsigned char)*read)) code_point = strtoul(read, &digits_end, 16);
+			} else if(read < end && isdigit((unsigned char)*read)) {
+				code_point = strtoul(read, &digits_end, 10);
+			}
+			if(errno || digits_end == read || digits_end >= end || *digits_end != ';' || !code_point || code_point > 0x10FFFF || (code_point >= 0xD800 && code_point < 0xE000)) {
+				free(result);
+				return NULL;
+			}
+			write += put_utf8(write, code_point);
+			read = digits_end + 1;
+		} else {
+			for(counter = 0; counter < named_entity_count; ++counter) {
+				if((size_t)(end - read) >= named_entity_length[counter] && !memcmp(read, named_entity[counter], named_entity_length[counter])) break;
+			}
+			if(counter == named_entity_count) {
+				free(result);
+				return NULL;
+			}
+			*(write++) = named_entity_value[counter];
+			read += named_entity_length[counter];
+		}
+	}
+	memcpy(write, read, end - read);
+	write += end - read;
+	*write = '\0';
 	return result;
 }
 
-static char * get_url_from_json(struct json_object * video) {
-	struct json_object * file = NULL;
-	const char * encoded_url_ref = NULL;
-	char * result = NULL;
-	size_t length = 0;
-	int bad = 0;
+/* Walks the attributes of the start tag found by the scanner and decodes
+ * the value of player_data. No DOM is built and memchr skips over the
+ * values of every attribute. */
+char * extract_raw_json_fast(const char * html_page, const struct player_data_scanner * scanner) {
+	static const char attr_name[12] = "player_data";
+	static const size_t attr_name_length = 11;
+	const char * position = html_page + scanner->element_start + 4;
+	const char * end = html_page + scanner->element_end - 1;
+	const char * name = NULL;
+	const char * value = NULL;
+	const char * value_end = NULL;
+	size_t name_length = 0;
+	char quote = 0;
+
+	while(position < end) {
+		while(position < end && is_html_space(*position)) ++position;
+		name = position;
+		while(position < end && !is_html_space(*position) && *position != '=' && *position != '/') ++position;
+		name_length = position - name;
+		if(!name_length) {
+			++position;
+			continue;
+		}
 
-	bad = !json_object_object_get_ex(video, "file", &file);
-	if(bad) {
-		fprintf(stderr,"get_url_from_json: video has no file object.\n");
-		return result;
+		while(position < end && is_html_space(*position)) ++position;
+		value = position;
+		value_end = position;
+		if(position < end && *position == '=') {
+			++position;
+			while(position < end && is_html_space(*position)) ++position;
+			if(position < end && (*position == '"' || *position == '\'')) {
+				quote = *(position++);
+				value = position;
+				value_end = memchr(position, quote, end - position);
+				if(value_end == NULL) return NULL;
+				position = value_end + 1;
+			} else {
+				value = position;
+				while(position < end && !is_html_space(*position)) ++position;
+				value_end = position;
+			}
+		}
+
+		if(name_length == attr_name_length && !strncasecmp(name, attr_name, attr_name_length)) {
+			return decode_html_entities(value, value_end - value);
+		}
 	}
+	return NULL;
+}
 
-	encoded_url_ref = json_object_get_string(file);
-	if(encoded_url_ref == NULL) {
-		fprintf(stderr,"get_url_from_json: could not obtain file string.\n");
-		return result;
+/* A scanner that already followed the download spares us the search.
+ * Otherwise the page is scanned here in one go. */
+static char * extract_raw_json_from_html(const char * video_id, const char * html_page, const size_t html_page_length, const struct player_data_scanner * scanner) {
+	struct player_data_scanner own_scanner = {0};
+	struct known_size_memory_region whole_page;
+	char * player_id = NULL;
+	char * result = NULL;
+
+	if(scanner == NULL || scanner->state != PLAYER_SCANNER_DONE) {
+		player_id = get_player_id(video_id);
+		if(player_id != NULL) {
+			own_scanner.needle = player_id;
+			own_scanner.needle_length = strlen(player_id);
+			whole_page.memory = (char *)html_page;
+			whole_page.size = html_page_length;
+			scan_for_player_data(&own_scanner, &whole_page);
+		}
+		scanner = &own_scanner;
 	}
-	length = strlen(encoded_url_ref);
 
-	result = decode_url(encoded_url_ref, length);
+	if(scanner->state == PLAYER_SCANNER_DONE) result = extract_raw_json_fast(html_page, scanner);
+	free(player_id);
+	if(result == NULL) result = extract_raw_json_with_libxml2(video_id, html_page, html_page_length);
 	return result;
 }
 
-static char * get_extra_url(const char * template_url, const char * quality) {
-	static const char middle[9] = "?wersja=";
-	static size_t middle_length = 8;
-	size_t template_url_length = strlen(template_url);
-	size_t quality_length = strlen(quality);
-	size_t total_length = template_url_length + middle_length + quality_length;
-	char * result = malloc(total_length + 1);
-	if(result == NULL) {
-		fprintf(stderr,"get_qualified_url: allocation error.\n");
-	} else {
-		memcpy(result, template_url, template_url_length);
-		memcpy(result + template_url_length, middle, middle_length);
-		memcpy(result + template_url_length + middle_length, quality, quality_length);
-		result[total_length] = '\0';
-	}
-	return result;
+void free_player_data(struct player_data * i) {
+	free(i->raw_json);
+	i->raw_json = NULL;
+	if(i->big_json != NULL) json_object_put(i->big_json);
+	i->big_json = NULL;
+	free(i->qualities);
+	i->qualities = NULL;
+	i->qualities_count = 0;
 }
 
-static char * get_m3u8_link(struct json_object * small_json) {
-	size_t length = 0;
-	struct json_object * jsonic_crosshair = NULL;
-	char * result = NULL;
-	const char * tmp = NULL;
-	int object_exists = json_object_object_get_ex(small_json, "manifest_apple", &jsonic_crosshair);
-	if(object_exists) {
-		tmp = json_object_get_string(jsonic_crosshair);
-		length = strlen(tmp);
-		result = malloc(length + 1);
-		if(result == NULL) {
-			fprintf(stderr, "get_m3u8_link: could not allocate memory for result.\n");
-			return NULL;
+/* Writes out a slice with its escape sequences resolved. No escape sequence
+ * is shorter than what it stands for, so length + 1 bytes are enough. */
+static void json_unescape(const struct json_slice * slice, char * output) {
+	static const char escape_letter[8] = "\"\\/bfnrt";
+	static const char escape_value[8] = {'"', '\\', '/', '\b', '\f', '\n', '\r', '\t'};
+	const char * read = slice->start;
+	const char * end = slice->start + slice->length;
+	const char * backslash = NULL;
+	const char * letter = NULL;
+	char hex[5] = {0};
+	unsigned long code_point = 0;
+	unsigned long low_surrogate = 0;
+
+	while((backslash = memchr(read, '\\', end - read)) != NULL && backslash + 1 < end) {
+		memcpy(output, read, backslash - read);
+		output += backslash - read;
+		read = backslash + 2;
+		letter = memchr(escape_letter, backslash[1], 8);
+		if(letter != NULL) {
+			*(output++) = escape_value[letter - escape_letter];
+		} else if(backslash[1] == 'u' && end - read >= 4) {
+			memcpy(hex, read, 4);
+			code_point = strtoul(hex, NULL, 16);
+			read += 4;
+			if(code_point >= 0xD800 && code_point < 0xDC00 && end - read >= 6 && read[0] == '\\' && read[1] == 'u') {
+				memcpy(hex, read + 2, 4);
+				low_surrogate = strtoul(hex, NULL, 16);
+				if(low_surrogate >= 0xDC00 && low_surrogate < 0xE000) {
+					code_point = 0x10000 + ((code_point - 0xD800) << 10) + (low_surrogate - 0xDC00);
+					read += 6;
+				}
+			}
+			if(code_point >= 0xD800 && code_point < 0xE000) code_point = 0xFFFD;
+			output += put_utf8(output, code_point);
+		} else {
+			*(output++) = backslash[1];
 		}
-		memcpy(result, tmp, length);
-		result[length] = 0;
 	}
-	return result;
+	memcpy(output, read, end - read);
+	output[end - read] = '\0';
 }
 
-void libcda_get_url2json(struct cda_results * i) {
+char * json_slice_dup(const struct json_slice * slice) {
+	char * result = malloc(slice->length + 1);
+	if(result == NULL) {
+		fprintf(stderr, "json_slice_dup: could not allocate memory for result.\n");
+	} else if(slice->escaped) {
+		json_unescape(slice, result);
+	} else {
+		memcpy(result, slice->start, slice->length);
+		result[slice->length] = '\0';
+	}
+	return result;
+}
+
+/* json_slice_dup into the strings of a draft; returns where the copy went. */
+static size_t json_slice_to_draft(const struct json_slice * slice, struct results_draft * draft) {
+	char * copy = reserve_draft_strings(draft, slice->length + 1);
+	size_t offset = draft->strings_size;
+	if(copy == NULL) return RESULTS_DRAFT_NO_STRING;
+	if(slice->escaped) {
+		json_unescape(slice, copy);
+		draft->strings_size += strlen(copy) + 1;
+	} else {
+		memcpy(copy, slice->start, slice->length);
+		copy[slice->length] = '\0';
+		draft->strings_size += slice->length + 1;
+	}
+	return offset;
+}
+
+static int json_key_is(const struct json_slice * key, const char * name, const size_t name_length) {
+	return !key->escaped && key->length == name_length && !memcmp(key->start, name, name_length);
+}
+
+static void json_c_slice(struct json_object * string, struct json_slice * slice) {
+	slice->length = json_object_get_string_len(string);
+	slice->start = slice->length ? json_object_get_string(string) : NULL;
+	slice->escaped = 0;
+}
+
+__attribute__((no_stack_protector)) static struct json_object * find_small_json(struct json_object * big_json) {
+	static const char bad_message[48] = "find_small_json: JSON has no video dictionary.\n";
+	static const char good_message[1] = {0};
+	struct json_object * result = NULL;
+	size_t good = -json_object_object_get_ex(big_json, "video", &result);
+	char * actual_message = (char *)(((size_t)good_message & good)|((size_t)bad_message & ~good));
+	(void)fputs(actual_message, stderr);
+	return result;
+}
+
+int read_player_data_with_json_c(struct player_data * i) {
+	struct json_object * small_json = NULL;
+	struct json_object * jsonic_crosshair = NULL;
+	size_t counter = 0;
+
+	i->big_json = json_tokener_parse(i->raw_json);
+	if(i->big_json == NULL) return 1;
+
+	small_json = find_small_json(i->big_json);
+	if(small_json == NULL) return 0;
+	i->has_video = 1;
+
+	if(json_object_object_get_ex(small_json, "file", &jsonic_crosshair)) json_c_slice(jsonic_crosshair, &(i->file));
+	if(json_object_object_get_ex(small_json, "manifest_apple", &jsonic_crosshair)) json_c_slice(jsonic_crosshair, &(i->manifest_apple));
+	if(json_object_object_get_ex(small_json, "quality", &jsonic_crosshair)) json_c_slice(jsonic_crosshair, &(i->quality));
+
+	if(json_object_object_get_ex(small_json, "qualities", &jsonic_crosshair) && json_object_is_type(jsonic_crosshair, json_type_object)) {
+		i->has_qualities = 1;
+		i->qualities_count = json_object_object_length(jsonic_crosshair);
+		i->qualities = calloc(i->qualities_count + 1, sizeof(struct json_slice));
+		if(i->qualities == NULL) return 1;
+		json_object_object_foreach(jsonic_crosshair, key, val) {
+			i->qualities[counter].start = key;
+			i->qualities[counter++].length = strlen(key);
+		}
+	}
+	return 0;
+}
+
+/* The lazy reader below walks player_data in place. It descends only into
+ * the dictionaries libcda needs and skips over everything else, so strings
+ * come out as slices of raw_json and nothing gets allocated for them. */
+#define JSON_MEMBER_FOUND	0
+#define JSON_OBJECT_END		1
+#define JSON_MALFORMED		2
+
+static const char * json_skip_space(const char * position, const char * end) {
+	while(position < end && (*position == ' ' || *position == '\t' || *position == '\n' || *position == '\r')) ++position;
+	return position;
+}
+
+/* position is just past the opening quote. Returns the closing quote. */
+static const char * json_string_end(const char * position, const char * end) {
+	const char * quote = NULL;
+	const char * backslash = NULL;
+	while((quote = memchr(position, '"', end - position)) != NULL) {
+		backslash = quote;
+		while(backslash > position && backslash[-1] == '\\') --backslash;
+		if(!((quote - backslash) & 1)) return quote;
+		position = quote + 1;
+	}
+	return NULL;
+}
+
+static int is_json_delimiter(const char c) {
+	return c == ',' || c == ':' || c == '}' || c == ']' || c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+/* Returns the first character after the value that starts at position */
+static const char * json_skip_value(const char * position, const char * end) {
+	const char * scalar = NULL;
+	size_t depth = 0;
+	do {
+		position = json_skip_space(position, end);
+		if(position >= end) return NULL;
+		switch(*position) {
+			case '"':
+				position = json_string_end(position + 1, end);
+				if(position == NULL) return NULL;
+				++position;
+				break;
+			case '{':
+			case '[':
+				++depth;
+				++position;
+				break;
+			case '}':
+			case ']':
+				if(!depth) return NULL;
+				--depth;
+				++position;
+				break;
+			case ',':
+			case ':':
+				if(!depth) return NULL;
+				++position;
+				break;
+			default:
+				scalar = position;
+				while(position < end && !is_json_delimiter(*position)) ++position;
+				if(position == scalar) return NULL;
+		}
+	} while(depth);
+	return position;
+}
+
+/* Moves to the next member of an object. position is right after its '{'
+ * or right after the value of the previous member. On JSON_MEMBER_FOUND
+ * it is left at the value of the member, and on JSON_OBJECT_END right
+ * after the closing brace. */
+static int json_next_member(const char ** position, const char * end, const char first, struct json_slice * key) {
+	const char * cursor = json_skip_space(*position, end);
+	if(cursor >= end) return JSON_MALFORMED;
+	if(*cursor == '}') {
+		*position = cursor + 1;
+		return JSON_OBJECT_END;
+	}
+	if(!first) {
+		if(*cursor != ',') return JSON_MALFORMED;
+		cursor = json_skip_space(cursor + 1, end);
+	}
+	if(cursor >= end || *cursor != '"') return JSON_MALFORMED;
+	key->start = ++cursor;
+	cursor = json_string_end(cursor, end);
+	if(cursor == NULL) return JSON_MALFORMED;
+	key->length = cursor - key->start;
+	key->escaped = (memchr(key->start, '\\', key->length) != NULL);
+	cursor = json_skip_space(cursor + 1, end);
+	if(cursor >= end || *cursor != ':') return JSON_MALFORMED;
+	*position = json_skip_space(cursor + 1, end);
+	return JSON_MEMBER_FOUND;
+}
+
+/* Anything but a string reads as an empty slice, like json-c would have it */
+static const char * json_read_string(const char * position, const char * end, struct json_slice * string) {
+	const char * closing_quote = NULL;
+	string->start = NULL;
+	string->length = 0;
+	string->escaped = 0;
+	if(position >= end || *position != '"') return json_skip_value(position, end);
+	closing_quote = json_string_end(position + 1, end);
+	if(closing_quote == NULL) return NULL;
+	string->start = position + 1;
+	string->length = closing_quote - string->start;
+	string->escaped = (memchr(string->start, '\\', string->length) != NULL);
+	return closing_quote + 1;
+}
+
+static const char * json_read_quality_keys(const char * position, const char * end, struct player_data * i) {
+	struct json_slice key;
+	struct json_slice * bigger = NULL;
+	size_t capacity = 8;
+	char first = 1;
+	int status = 0;
+
+	if(position >= end || *position != '{') return json_skip_value(position, end);
+	free(i->qualities);
+	i->qualities_count = 0;
+	i->qualities = malloc(capacity * sizeof(struct json_slice));
+	if(i->qualities == NULL) return NULL;
+	i->has_qualities = 1;
+
+	++position;
+	for(; (status = json_next_member(&position, end, first, &key)) == JSON_MEMBER_FOUND; first = 0) {
+		if(i->qualities_count == capacity) {
+			capacity <<= 1;
+			bigger = realloc(i->qualities, capacity * sizeof(struct json_slice));
+			if(bigger == NULL) return NULL;
+			i->qualities = bigger;
+		}
+		i->qualities[i->qualities_count++] = key;
+		position = json_skip_value(position, end);
+		if(position == NULL) return NULL;
+	}
+	return (status == JSON_OBJECT_END) ? position : NULL;
+}
+
+static const char * json_read_video(const char * position, const char * end, struct player_data * i) {
+	struct json_slice key;
+	char first = 1;
+	int status = 0;
+
+	if(position >= end || *position != '{') return json_skip_value(position, end);
+	i->has_video = 1;
+
+	++position;
+	for(; (status = json_next_member(&position, end, first, &key)) == JSON_MEMBER_FOUND; first = 0) {
+		if(json_key_is(&key, "file", 4)) position = json_read_string(position, end, &(i->file));
+		else if(json_key_is(&key, "manifest_apple", 14)) position = json_read_string(position, end, &(i->manifest_apple));
+		else if(json_key_is(&key, "quality", 7)) position = json_read_string(position, end, &(i->quality));
+		else if(json_key_is(&key, "qualities", 9)) position = json_read_quality_keys(position, end, i);
+		else position = json_skip_value(position, end);
+		if(position == NULL) return NULL;
+	}
+	return (status == JSON_OBJECT_END) ? position : NULL;
+}
+
+int read_player_data_lazily(struct player_data * i) {
+	const char * end = i->raw_json + i->raw_json_length;
+	const char * position = json_skip_space(i->raw_json, end);
+	struct json_slice key;
+	char first = 1;
+	int status = 0;
+
+	if(position >= end || *position != '{') return 1;
+	++position;
+	for(; (status = json_next_member(&position, end, first, &key)) == JSON_MEMBER_FOUND; first = 0) {
+		if(json_key_is(&key, "video", 5)) position = json_read_video(position, end, i);
+		else position = json_skip_value(position, end);
+		if(position == NULL) return 1;
+	}
+	if(status != JSON_OBJECT_END) return 1;
+	if(json_skip_space(position, end) != end) return 1;
+	if(!i->has_video) fputs("find_small_json: JSON has no video dictionary.\n", stderr);
+	return 0;
+}
+
+/* stats may be NULL */
+int parse_player_data(struct player_data * result, const char * video_id, struct known_size_memory_region * html_page, const struct player_data_scanner * scanner, const int json_parser, struct libcda_stats * stats) {
+	uint64_t started = stats != NULL ? monotonic_nanoseconds() : 0;
+	int bad = 0;
+	memset(result, 0, sizeof(struct player_data));
+
+	result->raw_json = extract_raw_json_from_html(video_id, html_page->memory, html_page->size, scanner);
+	if(stats != NULL) {
+		stats->html_time += monotonic_nanoseconds() - started;
+		started = monotonic_nanoseconds();
+	}
+	if(result->raw_json == NULL) {
+		fprintf(stderr,"parse_player_data: could not find JSON.\n");
+		return 1;
+	}
+	result->raw_json_length = strlen(result->raw_json);
+
+	if(json_parser == LIBCDA_JSON_PARSER_JSON_C) bad = read_player_data_with_json_c(result);
+	else bad = read_player_data_lazily(result);
+	if(stats != NULL) stats->json_time += monotonic_nanoseconds() - started;
+	if(bad) {
+		fprintf(stderr,"parse_player_data: parsing JSON failed.\n");
+	} else if(!result->has_video) {
+		bad = 1;
+	}
+	if(bad) free_player_data(result);
+	return bad;
+}
+
+__attribute__((no_stack_protector)) static char determine_json_type(const struct player_data * video) {
+	char result;
+	char is_m3u8;
+	char is_file;
+	is_file = !!video->file.length;
+	is_m3u8 = !!video->manifest_apple.length;
+
+	result = (is_file ^ is_m3u8) * (is_file | (is_m3u8 << 1));
+	return result;
+}
+
+static int count_qualities(const struct player_data * video, struct results_draft * draft) {
+	static const char ignore_this_quality[5] = "auto";
+	size_t key_counter = 0;
+	if(!video->has_qualities) {
+		fprintf(stderr,"count_qualities: video object does not contain qualities dictionary.\n");
+		return 1;
+	}
+	draft->quality_count = 0;
+	for(key_counter = 0; key_counter < video->qualities_count; ++key_counter) {
+		draft->quality_count += !json_key_is(video->qualities + key_counter, ignore_this_quality, 4);
+	}
+	if(!draft->quality_count) {
+		fprintf(stderr,"count_qualities: qualities dictionary is empty.\n");
+		return 1;
+	}
+	draft->quality = malloc(draft->quality_count * sizeof(size_t));
+	if(draft->quality == NULL) {
+		fprintf(stderr,"count_qualities: main allocation error.\n");
+		draft->quality_count = 0;
+		return 1;
+	}
+	draft->quality_count = 0;
+	for(key_counter = 0; key_counter < video->qualities_count; ++key_counter) {
+		if(!json_key_is(video->qualities + key_counter, ignore_this_quality, 4)) {
+			draft->quality[draft->quality_count] = json_slice_to_draft(video->qualities + key_counter, draft);
+			if(draft->quality[draft->quality_count] == RESULTS_DRAFT_NO_STRING) {
+				fprintf(stderr,"count_qualities: allocation error %zu\n", draft->quality_count);
+				return 1;
+			}
+			++draft->quality_count;
+		}
+	}
+	return 0;
+}
+
+static const char * translate_succinct_quality_to_resolutional_quality(const char * squality) {
+	static const char * all_known_rqualities[8] = {"144p", "240p", "360p", "480p", "720p", "1080p", "2K",  "4K"};
+	static const char * all_known_squalities[8] = {"144p", "240p", "vl",   "lq",   "sd",   "hd",    "qhd", "uhd"};
+	static const size_t ak_limit = 8;
+	char * result = NULL;
+	size_t counter = 0;
+	size_t keep_going = 1;
+	while(keep_going) {
+		keep_going = !!strcmp(squality, all_known_squalities[counter]);
+		result = (char *)(((size_t)all_known_rqualities[counter] & ~(-keep_going))|((size_t)result & -keep_going));
+		keep_going &= (++counter < ak_limit);
+	}
+	return result;
+}
+
+static const char * get_current_quality(const struct player_data * video) {
+	char * succinct_quality = NULL;
+	const char * result = NULL;
+
+	if(!video->quality.length) {
+		fputs("get_current_quality: video object has no quality string.\n", stderr);
+		return NULL;
+	}
+	succinct_quality = json_slice_dup(&(video->quality));
+	if(succinct_quality == NULL) {
+		fputs("get_current_quality: could not obtain quality string.\n", stderr);
+		return NULL;
+	}
+
+	result = translate_succinct_quality_to_resolutional_quality(succinct_quality);
+	free(succinct_quality);
+	return result;
+}
+
+/* Returns quality_count when quality is not among the qualities of draft */
+static size_t determine_quality_index(const struct results_draft * draft, const char * quality) {
+	size_t counter = 0;
+	while(counter < draft->quality_count && strcmp(draft_string(draft, draft->quality[counter]), quality)) ++counter;
+	return counter;
+}
+
+static unsigned long quality_height(const char * quality) {
+	if(!strcmp(quality, "2K")) return 1440;
+	if(!strcmp(quality, "4K")) return 2160;
+	return strtoul(quality, NULL, 10);
+}
+
+/* Picks the entry of qualities that preference asks for. LIBCDA_QUALITY_BEST
+ * is the tallest one, LIBCDA_QUALITY_AT_MOST the tallest one not taller
+ * than wanted, or the shortest one if they all are. Returns count when
+ * there is nothing to pick. */
+static size_t choose_quality(const char * const * qualities, const size_t count, const int preference, const char * wanted) {
+	const unsigned long limit = preference == LIBCDA_QUALITY_AT_MOST ? quality_height(wanted) : (unsigned long)-1;
+	unsigned long height = 0;
+	unsigned long chosen_height = 0;
+	unsigned long shortest_height = (unsigned long)-1;
+	size_t chosen = count;
+	size_t shortest = count;
+	size_t counter = 0;
+	for(counter = 0; counter < count; ++counter) {
+		if(preference == LIBCDA_QUALITY_EXACT) {
+			if(!strcmp(qualities[counter], wanted)) return counter;
+			continue;
+		}
+		height = quality_height(qualities[counter]);
+		if(height <= limit && (chosen == count || height > chosen_height)) {
+			chosen = counter;
+			chosen_height = height;
+		}
+		if(height < shortest_height) {
+			shortest = counter;
+			shortest_height = height;
+		}
+	}
+	return chosen != count ? chosen : shortest;
+}
+
+static size_t choose_draft_quality(const struct results_draft * draft, const int preference, const char * wanted) {
+	const char ** qualities = malloc(draft->quality_count * sizeof(char *));
+	size_t result = draft->quality_count;
+	size_t counter = 0;
+	if(qualities == NULL) {
+		fprintf(stderr, "choose_draft_quality: could not allocate memory.\n");
+		return result;
+	}
+	for(counter = 0; counter < draft->quality_count; ++counter) qualities[counter] = draft_string(draft, draft->quality[counter]);
+	result = choose_quality(qualities, draft->quality_count, preference, wanted);
+	free(qualities);
+	return result;
+}
+
+/* The key a result for preference is cached under, next to the NULL key
+ * of complete results: the quality itself, "<=" and the quality, or "best". */
+static char * preference_cache_key(const int preference, const char * wanted) {
+	char * result = NULL;
+	size_t length = 0;
+	switch(preference) {
+		case LIBCDA_QUALITY_EXACT:
+			result = strdup(wanted);
+			break;
+		case LIBCDA_QUALITY_AT_MOST:
+			length = strlen(wanted);
+			result = malloc(length + 3);
+			if(result != NULL) {
+				memcpy(result, "<=", 2);
+				memcpy(result + 2, wanted, length + 1);
+			}
+			break;
+		case LIBCDA_QUALITY_BEST:
+			result = strdup("best");
+			break;
+	}
+	if(result == NULL) fprintf(stderr, "preference_cache_key: could not allocate memory for key.\n");
+	return result;
+}
+
+#include "generic/decode_url.c"
+#if defined(__i386__) || defined(__amd64__)
+#	define LIBCDA_HAS_X86_KERNELS
+#	if defined(__i386__)
+#		include "mmx/decode_url.c"
+#	endif
+#	include "sse2/decode_url.c"
+#	include "ssse3/decode_url.c"
+#	include "avx2/decode_url.c"
+#	include "avx512/decode_url.c"
+#endif
+
+/* Ordered from best to worst; the first one the CPU supports wins. */
+const struct libcda_kernels kernel_table[] = {
+#if defined(LIBCDA_HAS_X86_KERNELS)
+	{"avx512vbmi2", "avx512vbmi2", weird_decoding_ritual_avx512, url_candidates_avx512, unquote_avx512},
+	{"avx512", "avx512bw", weird_decoding_ritual_avx512, url_candidates_avx512, unquote_avx2},
+	{"avx2", "avx2", weird_decoding_ritual_avx2, url_candidates_avx2, unquote_avx2},
+	{"ssse3", "ssse3", weird_decoding_ritual_sse2, url_candidates_sse2, unquote_ssse3},
+	{"sse2", "sse2", weird_decoding_ritual_sse2, url_candidates_sse2, unquote_generic},
+#	if defined(__i386__)
+	{"mmx", "mmx", weird_decoding_ritual_mmx, url_candidates_generic, unquote_generic},
+#	endif
+#endif
+	{"generic", NULL, weird_decoding_ritual_generic, url_candidates_generic, unquote_generic}
+};
+#define KERNEL_TABLE_SIZE (sizeof(kernel_table) / sizeof(kernel_table[0]))
+const size_t kernel_table_size = KERNEL_TABLE_SIZE;
+
+static const struct libcda_kernels * kernels = kernel_table + KERNEL_TABLE_SIZE - 1;
+
+int cpu_supports_kernel(const struct libcda_kernels * candidate) {
+	if(!candidate->cpu_feature) return 1;
+#if defined(LIBCDA_HAS_X86_KERNELS)
+	/* __builtin_cpu_supports only takes string literals. */
+	if(!strcmp(candidate->cpu_feature, "avx512vbmi2")) return __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw") && __builtin_cpu_supports("avx512vbmi2");
+	if(!strcmp(candidate->cpu_feature, "avx512bw")) return __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw");
+	if(!strcmp(candidate->cpu_feature, "avx2")) return __builtin_cpu_supports("avx2");
+	if(!strcmp(candidate->cpu_feature, "ssse3")) return __builtin_cpu_supports("ssse3");
+	if(!strcmp(candidate->cpu_feature, "sse2")) return __builtin_cpu_supports("sse2");
+	if(!strcmp(candidate->cpu_feature, "mmx")) return __builtin_cpu_supports("mmx");
+#endif
+	return 0;
+}
+
+/* Runs once when libcda is loaded. LIBCDA_SIMD may name a kernel to force,
+ * e.g. LIBCDA_SIMD=sse2; a kernel this CPU can't run is refused rather than
+ * left to die on SIGILL. */
+__attribute__((constructor))
+static void select_kernels(void) {
+	const char * forced = getenv("LIBCDA_SIMD");
+	size_t i;
+#if defined(LIBCDA_HAS_X86_KERNELS)
+	__builtin_cpu_init();
+	build_unquote_shuffles();
+#endif
+	if(forced && *forced) {
+		for(i = 0; i < KERNEL_TABLE_SIZE; ++i) {
+			if(strcasecmp(forced, kernel_table[i].name)) continue;
+			if(cpu_supports_kernel(kernel_table + i)) {
+				kernels = kernel_table + i;
+				return;
+			}
+			fprintf(stderr, "select_kernels: this CPU cannot run the %s kernel, ignoring LIBCDA_SIMD.\n", forced);
+			break;
+		}
+		if(i == KERNEL_TABLE_SIZE) fprintf(stderr, "select_kernels: unknown kernel %s in LIBCDA_SIMD, ignoring it.\n", forced);
+	}
+	for(i = 0; i < KERNEL_TABLE_SIZE; ++i) {
+		if(cpu_supports_kernel(kernel_table + i)) {
+			kernels = kernel_table + i;
+			return;
+		}
+	}
+}
+
+const char * libcda_simd_kernel(void) {
+	return kernels->name;
+}
+
+/* Tokens the player scatters through the file string. The removable ones come
+ * first and are stripped in this order; the rest are rewritten in place. */
+struct url_token {
+	const char * word;
+	size_t length;
+	const char * replacement;
+	size_t replacement_length;
+};
+
+static const struct url_token url_tokens[] = {
+	{"_XDDD", 5, NULL, 0},
+	{"_CDA", 4, NULL, 0},
+	{"_ADC", 4, NULL, 0},
+	{"_CXD", 4, NULL, 0},
+	{"_QWE", 4, NULL, 0},
+	{"_Q5", 3, NULL, 0},
+	{"_IKSDE", 6, NULL, 0},
+// .cda.mp4
+	{"%5D452%5D%3EAc", 14, NULL, 0},
+// .2cda.pl and .3cda.pl become .cda.pl
+	{"%5Da452%5DA%3D", 14, "%5D452%5DA%3D", 13},
+	{"%5Db452%5DA%3D", 14, "%5D452%5DA%3D", 13}
+};
+#define URL_TOKEN_COUNT 10
+#define URL_REMOVABLE_TOKEN_COUNT 8
+#define URL_UNDERSCORE_TOKEN_COUNT 7
+#define URL_TOKEN_MAX_LENGTH 14
+
+/* url_tokens keeps the tokens grouped by their first byte, and most '%' in a
+ * file string are plain escapes, so checking two more bytes weeds them out. */
+static const struct url_token * match_url_token(const char * at, const size_t available) {
+	const struct url_token * token = url_tokens;
+	const struct url_token * end = url_tokens + URL_UNDERSCORE_TOKEN_COUNT;
+	if(*at == '%') {
+		token = end;
+		end = url_tokens + URL_TOKEN_COUNT;
+	} else if(*at != '_') return NULL;
+	for(; token < end; ++token) {
+		if(token->length > available || at[1] != token->word[1] || at[token->length - 1] != token->word[token->length - 1]) continue;
+		if(!memcmp(at + 1, token->word + 1, token->length - 2)) return token;
+	}
+	return NULL;
+}
+
+/* Whether one of the first token_count tokens starts in the last bytes kept
+ * before a cut and ends in the bytes that follow it. */
+static int url_token_straddles_cut(const char * tail, const size_t tail_length, const char * next, const size_t next_length, const size_t token_count) {
+	const struct url_token * token = NULL;
+	size_t start;
+	size_t kept;
+	size_t k;
+	for(start = 0; start < tail_length; ++start) {
+		if(tail[start] != '_' && tail[start] != '%') continue;
+		kept = tail_length - start;
+		for(token = url_tokens; token < url_tokens + token_count; ++token) {
+			if(token->word[0] != tail[start] || token->length <= kept || token->length - kept > next_length) continue;
+			for(k = 1; k < kept && tail[start + k] == token->word[k]; ++k);
+			if(k == kept && !memcmp(next, token->word + kept, token->length - kept)) return 1;
+		}
+	}
+	return 0;
+}
+
+/* Cutting tokens out of a string one word at a time, as
+ * remove_certain_words_one_by_one does, can join the bytes around a cut into
+ * another token that a later word then cuts too. Doing every cut in one pass
+ * only gives the same string when that never happens, so the passes that do
+ * follow the bytes that survive and check each cut. */
+struct url_cut_tracker {
+	char tail[2 * URL_TOKEN_MAX_LENGTH];
+	size_t tail_length;
+	size_t stretch_start;
+};
+
+/* Records that string[cut_start, cut_end) goes and returns whether that joins
+ * the bytes around it into one of the first token_count tokens. */
+static int cut_url_token(struct url_cut_tracker * tracker, const char * string, const size_t cut_start, const size_t cut_end, const size_t length, const size_t token_count) {
+	size_t stretch_length = cut_start - tracker->stretch_start;
+	if(stretch_length >= URL_TOKEN_MAX_LENGTH - 1) {
+		tracker->tail_length = URL_TOKEN_MAX_LENGTH - 1;
+		memcpy(tracker->tail, string + cut_start - tracker->tail_length, tracker->tail_length);
+	} else {
+		memcpy(tracker->tail + tracker->tail_length, string + tracker->stretch_start, stretch_length);
+		tracker->tail_length += stretch_length;
+		if(tracker->tail_length > URL_TOKEN_MAX_LENGTH - 1) {
+			memmove(tracker->tail, tracker->tail + tracker->tail_length - (URL_TOKEN_MAX_LENGTH - 1), URL_TOKEN_MAX_LENGTH - 1);
+			tracker->tail_length = URL_TOKEN_MAX_LENGTH - 1;
+		}
+	}
+	tracker->stretch_start = cut_end;
+	return url_token_straddles_cut(tracker->tail, tracker->tail_length, string + cut_end, length - cut_end, token_count);
+}
+
+/* Strips each word in turn, as the old strstr and memmove loop did, but closes
+ * the gaps as it goes so each word costs one pass. None of the words can
+ * overlap itself, so taking an occurrence off the end of what has been kept
+ * so far gives the same string as taking the leftmost one out until there are
+ * none left, including occurrences that only form once another one is gone. */
+static size_t remove_certain_words_one_by_one(char * input_string) {
+	const struct url_token * token = NULL;
+	const char * first = NULL;
+	size_t length = strlen(input_string);
+	size_t original_length = length;
+	size_t read_position;
+	size_t write_position;
+	for(token = url_tokens; token < url_tokens + URL_REMOVABLE_TOKEN_COUNT; ++token) {
+		/* Nothing before the first occurrence moves. */
+		if(!(first = strstr(input_string, token->word))) continue;
+		for(read_position = write_position = first - input_string; read_position < length; ++read_position) {
+			input_string[write_position++] = input_string[read_position];
+			if(write_position >= token->length && input_string[write_position - 1] == token->word[token->length - 1]
+			&& !memcmp(input_string + write_position - token->length, token->word, token->length)) write_position -= token->length;
+		}
+		input_string[write_position] = '\0';
+		length = write_position;
+	}
+	return original_length - length;
+}
+
+struct url_cut {
+	size_t start;
+	size_t end;
+};
+
+/* Finds every removable token in one scan and closes the gaps with one
+ * streaming copy, unless a cut would form a new token. */
+static size_t remove_certain_words(char * input_string) {
+	struct url_cut_tracker tracker = {0};
+	struct url_cut stack_cuts[16];
+	struct url_cut * cuts = stack_cuts;
+	struct url_cut * grown_cuts = NULL;
+	const struct url_token * token = NULL;
+	size_t length = strlen(input_string);
+	size_t capacity = sizeof(stack_cuts) / sizeof(stack_cuts[0]);
+	size_t count = 0;
+	size_t block = 0;
+	size_t position = 0;
+	size_t write_position = 0;
+	size_t saved_bytes = 0;
+	size_t next_start;
+	size_t counter;
+	uint64_t candidates;
+	int one_by_one = 0;
+
+	for(; block < length && !one_by_one; block += 64) {
+		candidates = kernels->url_candidates(input_string + block, length - block);
+		/* A token cut from the previous block may reach into this one. */
+		if(position > block) candidates = position - block < 64 ? candidates & (~(uint64_t)0 << (position - block)) : 0;
+		while(candidates) {
+			position = block + __builtin_ctzll(candidates);
+			candidates &= candidates - 1;
+			token = match_url_token(input_string + position, length - position);
+			if(!token || token->replacement) continue;
+			if(count == capacity) {
+				grown_cuts = realloc(cuts == stack_cuts ? NULL : cuts, 2 * capacity * sizeof(*cuts));
+				if(!grown_cuts) {
+					one_by_one = 1;
+					break;
+				}
+				if(cuts == stack_cuts) memcpy(grown_cuts, stack_cuts, sizeof(stack_cuts));
+				cuts = grown_cuts;
+				capacity *= 2;
+			}
+			cuts[count].start = position;
+			cuts[count++].end = position + token->length;
+			if(cut_url_token(&tracker, input_string, position, position + token->length, length, URL_REMOVABLE_TOKEN_COUNT)) {
+				one_by_one = 1;
+				break;
+			}
+			position += token->length;
+			candidates = position - block < 64 ? candidates & (~(uint64_t)0 << (position - block)) : 0;
+		}
+	}
+	if(!one_by_one && count) {
+		write_position = cuts[0].start;
+		for(counter = 0; counter < count; ++counter) {
+			next_start = counter + 1 < count ? cuts[counter + 1].start : length + 1;
+			memmove(input_string + write_position, input_string + cuts[counter].end, next_start - cuts[counter].end);
+			write_position += next_start - cuts[counter].end;
+			saved_bytes += cuts[counter].end - cuts[counter].start;
+		}
+	}
+	if(cuts != stack_cuts) free(cuts);
+	if(one_by_one) return remove_certain_words_one_by_one(input_string);
+	return saved_bytes;
+}
+
+/* Rewrites every occurrence left to right like the strstr and memmove loop it
+ * replaces, but moves the rest of the string once per word rather than once
+ * per occurrence. */
+static size_t replace_certain_words(char * input_string) {
+	const struct url_token * token = NULL;
+	size_t counter = URL_REMOVABLE_TOKEN_COUNT;
+	size_t saved_bytes = 0;
+	char * read_pos = NULL;
+	char * write_pos = NULL;
+	char * pos = NULL;
+	for(; counter < URL_TOKEN_COUNT; ++counter) {
+		token = url_tokens + counter;
+		read_pos = write_pos = input_string;
+		while ((pos = strstr(read_pos, token->word)) != NULL) {
+			memmove(write_pos, read_pos, pos - read_pos);
+			write_pos += pos - read_pos;
+			memcpy(write_pos, token->replacement, token->replacement_length);
+			write_pos += token->replacement_length;
+			read_pos = pos + token->length;
+			saved_bytes += token->length - token->replacement_length;
+		}
+		if(write_pos != read_pos) memmove(write_pos, read_pos, strlen(read_pos) + 1);
+	}
+	return saved_bytes;
+}
+
+/* Decodes every escape in place and returns how many bytes that saved. The
+ * caller has already made sure none of them is cut short. */
+static size_t unquote(char * string, const size_t length) {
+	size_t consumed;
+	return length - kernels->unquote(string, string, length, &consumed);
+}
+
+/* unquote takes the two bytes after every '%' on faith. */
+static int has_truncated_escape(const char * string, const size_t length) {
+	size_t i = 0;
+	while(i < length) i += string[i] == '%' ? 3 : 1;
+	return i > length;
+}
+
+char * decode_url_in_stages(const char * encoded_url, const size_t length) {
+	static char protocol[9] = "https://";
+	static char extension[5] = ".mp4";
+	char * result = NULL;
+	void * intermediate = NULL;
+	size_t remove_that_many_bytes = 0;
+	size_t actionable_length = length;
+
+// For debugging
+//	printf("Decoding URL[%zu]: %s\n", length, encoded_url);
+	/* Room for the terminator, rounded up to whole vectors as aligned_alloc
+	 * wants a size that is a multiple of the alignment. */
+	size_t size_for_simd = (length + LIBCDA_SIMD_ALIGNMENT) & ~((size_t)LIBCDA_SIMD_ALIGNMENT - 1);
+
+	intermediate = aligned_alloc(LIBCDA_SIMD_ALIGNMENT, size_for_simd);
+	if(!intermediate) {
+		fprintf(stderr, "decode_url: could not allocate %zu bytes.\n", size_for_simd);
+		return NULL;
+	}
+
+	memcpy(intermediate, encoded_url, length);
+	((char *)intermediate)[length] = '\0';
+	
+	remove_that_many_bytes += remove_certain_words(intermediate);
+	remove_that_many_bytes += replace_certain_words(intermediate);
+	actionable_length -= remove_that_many_bytes;
+	if(has_truncated_escape(intermediate, actionable_length)) {
+		fprintf(stderr, "decode_url: file string ends in a truncated escape.\n");
+		free(intermediate);
+		return NULL;
+	}
+
+	remove_that_many_bytes += unquote(intermediate, actionable_length);
+	actionable_length = length - remove_that_many_bytes;
+
+	kernels->weird_decoding_ritual(intermediate, actionable_length);
+
+	result = malloc(actionable_length + 13);
+	if(result == NULL) {
+		fprintf(stderr, "decode_url: could not allocate %zu bytes.\n", actionable_length + 13);
+		free(intermediate);
+		return NULL;
+	}
+	memcpy(result, protocol, 8);
+	memcpy(result + 8, intermediate, actionable_length);
+	memcpy(result + 8 + actionable_length, extension, 4);
+	result[actionable_length + 12] = '\0';
+	free(intermediate);
+	return result;
+}
+
+/* Walks the candidates in a string 64 bytes at a time, so each one costs a
+ * shift and a bit scan rather than a trip through the vector kernel. */
+struct url_candidate_scan {
+	const char * string;
+	size_t length;
+	size_t block;
+	uint64_t mask;
+};
+
+static void start_url_candidate_scan(struct url_candidate_scan * scan, const char * string, const size_t length) {
+	scan->string = string;
+	scan->length = length;
+	scan->block = (size_t)-1;
+	scan->mask = 0;
+}
+
+/* Position of the first candidate at or after from, or the length. */
+static size_t next_url_candidate(struct url_candidate_scan * scan, const size_t from) {
+	size_t block = from & ~(size_t)63;
+	uint64_t mask;
+	for(; block < scan->length; block += 64) {
+		if(block != scan->block) {
+			scan->block = block;
+			scan->mask = kernels->url_candidates(scan->string + block, scan->length - block);
+		}
+		mask = from > block ? scan->mask & (~(uint64_t)0 << (from - block)) : scan->mask;
+		if(mask) return block + __builtin_ctzll(mask);
+	}
+	return scan->length;
+}
+
+/* The fused decoder below does in one forward pass what remove_certain_words,
+ * replace_certain_words, unquote and weird_decoding_ritual do in four. Strings
+ * where that would cut a token and join its neighbours into another one are
+ * left to decode_url_in_stages.
+ * Returns 0 and the decoded length, 1 if the string needs the staged pipeline
+ * or -1 if it can't be decoded at all. output must have room for length bytes. */
+static int decode_url_in_one_pass(const char * encoded_url, const size_t length, char * output, size_t * decoded_length) {
+	const struct url_token * token = NULL;
+	struct url_cut_tracker tracker = {0};
+	struct url_candidate_scan scan;
+	size_t written = 0;
+	char escape[2];
+	int escape_pending = 0;
+	size_t i = 0;
+	size_t k;
+	size_t run;
+	char c;
+
+	/* The staged pipeline stops at an embedded NUL in some steps and not in others. */
+	if(memchr(encoded_url, '\0', length)) return 1;
+	start_url_candidate_scan(&scan, encoded_url, length);
+	while(i < length) {
+		if(!escape_pending) {
+			run = next_url_candidate(&scan, i) - i;
+			for(k = 0; k < run; ++k) output[written + k] = rotate_url_byte(encoded_url[i + k]);
+			written += run;
+			i += run;
+			if(i == length) break;
+		}
+		c = encoded_url[i];
+		token = match_url_token(encoded_url + i, length - i);
+		if(token && !token->replacement) {
+			if(cut_url_token(&tracker, encoded_url, i, i + token->length, length, URL_TOKEN_COUNT)) return 1;
+			i += token->length;
+			continue;
+		}
+		if(token) {
+			i += token->length;
+			for(k = 0; k < token->replacement_length; ++k) {
+				c = token->replacement[k];
+				if(escape_pending) {
+					escape[2 - escape_pending] = c;
+					if(--escape_pending) continue;
+					c = unescape_url_byte(escape[0], escape[1]);
+				} else if(c == '%') {
+					escape_pending = 2;
+					continue;
+				}
+				output[written++] = rotate_url_byte(c);
+			}
+			continue;
+		}
+		/* An escape with both digits in plain sight, which is nearly all of them. */
+		if(c == '%' && !escape_pending && i + 2 < length
+		&& encoded_url[i + 1] != '_' && encoded_url[i + 1] != '%'
+		&& encoded_url[i + 2] != '_' && encoded_url[i + 2] != '%') {
+			output[written++] = rotate_url_byte(unescape_url_byte(encoded_url[i + 1], encoded_url[i + 2]));
+			i += 3;
+			continue;
+		}
+		++i;
+		if(escape_pending) {
+			escape[2 - escape_pending] = c;
+			if(--escape_pending) continue;
+			output[written++] = rotate_url_byte(unescape_url_byte(escape[0], escape[1]));
+		} else if(c == '%') {
+			escape_pending = 2;
+		} else {
+			output[written++] = rotate_url_byte(c);
+		}
+	}
+	/* unquote would read past the end of the string here and the staged
+	 * pipeline goes on to copy a wrapped-around length. */
+	if(escape_pending) {
+		fprintf(stderr, "decode_url_in_one_pass: file string ends in a truncated escape.\n");
+		return -1;
+	}
+	*decoded_length = written;
+	return 0;
+}
+
+/* Decodes straight into the strings of draft and returns where it went. */
+size_t decode_url(const char * encoded_url, const size_t length, struct results_draft * draft) {
+	static char protocol[9] = "https://";
+	static char extension[5] = ".mp4";
+	char * result = reserve_draft_strings(draft, length + 13);
+	char * staged = NULL;
+	size_t offset = draft->strings_size;
+	size_t decoded_length;
+
+	if(!result) return RESULTS_DRAFT_NO_STRING;
+	switch(decode_url_in_one_pass(encoded_url, length, result + 8, &decoded_length)) {
+		case 0:
+			break;
+		case 1:
+			staged = decode_url_in_stages(encoded_url, length);
+			if(staged == NULL) return RESULTS_DRAFT_NO_STRING;
+			decoded_length = strlen(staged) + 1;
+			memcpy(result, staged, decoded_length);
+			free(staged);
+			draft->strings_size += decoded_length;
+			return offset;
+		default:
+			return RESULTS_DRAFT_NO_STRING;
+	}
+	memcpy(result, protocol, 8);
+	memcpy(result + 8 + decoded_length, extension, 4);
+	result[decoded_length + 12] = '\0';
+	draft->strings_size += decoded_length + 13;
+	return offset;
+}
+
+size_t get_url_from_json(const struct player_data * video, struct results_draft * draft) {
+	char * encoded_url = NULL;
+	size_t result = RESULTS_DRAFT_NO_STRING;
+
+	if(!video->file.length) {
+		fprintf(stderr,"get_url_from_json: video has no file string.\n");
+		return result;
+	}
+	if(!video->file.escaped) return decode_url(video->file.start, video->file.length, draft);
+
+	encoded_url = json_slice_dup(&(video->file));
+	if(encoded_url == NULL) {
+		fprintf(stderr,"get_url_from_json: could not obtain file string.\n");
+		return result;
+	}
+	result = decode_url(encoded_url, strlen(encoded_url), draft);
+	free(encoded_url);
+	return result;
+}
+
+static char * get_extra_url(const char * template_url, const char * quality) {
+	static const char middle[9] = "?wersja=";
+	static size_t middle_length = 8;
+	size_t template_url_length = strlen(template_url);
+	size_t quality_length = strlen(quality);
+	size_t total_length = template_url_length + middle_length + quality_length;
+	char * result = malloc(total_length + 1);
+	if(result == NULL) {
+		fprintf(stderr,"get_qualified_url: allocation error.\n");
+	} else {
+		memcpy(result, template_url, template_url_length);
+		memcpy(result + template_url_length, middle, middle_length);
+		memcpy(result + template_url_length + middle_length, quality, quality_length);
+		result[total_length] = '\0';
+	}
+	return result;
+}
+
+static size_t get_m3u8_link(const struct player_data * video, struct results_draft * draft) {
+	size_t result = RESULTS_DRAFT_NO_STRING;
+	if(video->manifest_apple.length) result = json_slice_to_draft(&(video->manifest_apple), draft);
+	return result;
+}
+
+/* The JSON libcda_get_url2json prints, as a string of its own the caller
+ * frees, or NULL when there is no memory for it. A url entry that is
+ * missing, as in a lazy or partial result, comes out as null. */
+char * libcda_results_json(const struct cda_results * i) {
 	static const char * known_json_types[3] = {"none", "file", "m3u8"};
 	static const char part_0[15] = "{\"json_type\":\"";
 	static const size_t part_0l = 14;
@@ -648,264 +2471,1360 @@ void libcda_get_url2json(struct cda_results * i) {
 	static const size_t part_2l = 10;
 	static const char part_3[3] = {']','}','\0'};
 	static const size_t part_3l = 3;
+	static const char missing_url[5] = "null";
+	static const size_t missing_urll = 4;
+
+/* Write-only memory must be as big as biggest part_x */
+	char wom[16];
+
+	size_t * quality_lengths;
+	size_t * url_lengths;
+	size_t condition;
+	size_t the_most_important_allocation_succeeded;
+
+	const char * actual_json_type = known_json_types[(size_t)(i->json_type)];
+	const size_t actual_json_type_length = strlen(actual_json_type);
+
+	char * result;
+	char * dump_here;
+	size_t q_limit;
+	size_t u_limit;
+	size_t counter;
+
+/* Minimum length to store */
+	size_t length = part_0l + actual_json_type_length + part_1l + part_2l + part_3l;
+
+	quality_lengths = malloc(sizeof(size_t) * i->quality_count);
+	condition = -(quality_lengths != NULL);
+	q_limit = (i->quality_count & condition)|(0 & ~condition);
+	for(counter = 0; counter < q_limit; ++counter) {
+		quality_lengths[counter] = strlen(i->quality[counter]);
+		length += quality_lengths[counter];
+	}
+	length += (q_limit << 1);
+	condition = -(q_limit > 1);
+	length += ((q_limit - 1) & condition)|(0 & ~condition);
+
+/* The prefetch of a lazy result may fill url in meanwhile */
+	lock_lazy_urls(i);
+	url_lengths = malloc(sizeof(size_t) * i->url_count);
+	condition = -(url_lengths != NULL);
+	u_limit = (i->url_count & condition)|(0 & ~condition);
+	for(counter = 0; counter < u_limit; ++counter) {
+/* null stands in for the quotes as well */
+		url_lengths[counter] = i->url[counter] != NULL ? strlen(i->url[counter]) : missing_urll - 2;
+		length += url_lengths[counter];
+	}
+	length += (u_limit << 1);
+	condition = -(u_limit > 1);
+	length += ((u_limit - 1) & condition)|(0 & ~condition);
+
+/* Copy: {"json_type":"
+*/	result = malloc(length);
+	the_most_important_allocation_succeeded = -(result != NULL);
+	dump_here = (char *)(((size_t)result & the_most_important_allocation_succeeded)|((size_t)wom & ~the_most_important_allocation_succeeded));
+	memcpy(dump_here, part_0, part_0l);
+	dump_here += (part_0l & the_most_important_allocation_succeeded)|(0 & ~the_most_important_allocation_succeeded);
+
+/* Copy: json_type
+*/	memcpy(dump_here, actual_json_type, actual_json_type_length);
+	dump_here += (actual_json_type_length & the_most_important_allocation_succeeded)|(0 & ~the_most_important_allocation_succeeded);
+
+/* Copy: ","qualities":[
+*/	memcpy(dump_here, part_1, part_1l);
+	dump_here += (part_1l & the_most_important_allocation_succeeded)|(0 & ~the_most_important_allocation_succeeded);
+
+/* Copy: qualities from json
+*/	for(counter = 0; counter < q_limit; ++counter) {
+		(dump_here++)[0] = '"';
+		memcpy(dump_here, i->quality[counter], quality_lengths[counter]);
+		dump_here += quality_lengths[counter];
+		(dump_here++)[0] = '"';
+		condition = -(counter + 1 < q_limit);
+		dump_here[0] = (',' & condition)|(dump_here[0] & ~condition);
+		dump_here += !!condition;
+	}
+	free(quality_lengths);
+
+/* Copy: part_2
+*/	memcpy(dump_here, part_2, part_2l);
+	dump_here += (part_2l & the_most_important_allocation_succeeded)|(0 & ~the_most_important_allocation_succeeded);
+
+/* Copy: urls from json
+*/	for(counter = 0; counter < u_limit; ++counter) {
+		if(i->url[counter] != NULL) {
+			(dump_here++)[0] = '"';
+			memcpy(dump_here, i->url[counter], url_lengths[counter]);
+			dump_here += url_lengths[counter];
+			(dump_here++)[0] = '"';
+		} else {
+			memcpy(dump_here, missing_url, missing_urll);
+			dump_here += missing_urll;
+		}
+		condition = -(counter + 1 < u_limit);
+		dump_here[0] = (',' & condition)|(dump_here[0] & ~condition);
+		dump_here += !!condition;
+	}
+	free(url_lengths);
+	unlock_lazy_urls(i);
+
+/* Copy: ]}\0
+*/	memcpy(dump_here, part_3, part_3l);
+
+/* This memset will ensure, that even if result was wom all this time,
+ * no garbage will be left behind. */
+	memset(wom, 0, 16);
+	return result;
+}
+
+void libcda_get_url2json(struct cda_results * i) {
+	char * json = libcda_results_json(i);
+	puts(json != NULL ? json : "");
+	free(json);
+}
+
+/* A job follows one page from its first download to the finished result.
+ * Every page a job needs is a transfer, and the transfers of all jobs share
+ * one multi handle, which is the only place that waits. A job with a
+ * callback is an allocation of its own and hands its result over to the
+ * callback when done. */
+struct libcda_job {
+	struct libcda_session * session;
+	libcda_result_callback callback;
+	void * userdata;
+	libcda_url_callback on_url;
+	char * preferred_quality;
+	char * cache_quality;
+	int preference;
+	char * page_url;
+	int defer_qualities;
+	struct cda_results * lazy_results;
+	const size_t * lazy_indices;
+	size_t lazy_count;
+	char * video_id;
+	char * player_id;
+	struct results_draft draft;
+	struct cda_results * result;
+	struct libcda_cache * cache;
+	struct libcda_disk_cache * disk_cache;
+	struct libcda_stats stats;
+	uint64_t started;
+	size_t pending;
+	int status;
+};
+
+struct libcda_transfer {
+	struct libcda_job * job;
+	struct libcda_transfer * previous;
+	struct libcda_transfer * next;
+	struct known_size_memory_region * page;
+	struct player_data_scanner scanner;
+	char * url;
+	CURL * curl;
+	size_t url_index;
+	char draining;
+};
+
+/* url_index of the transfer that downloads the page a job starts with */
+#define LIBCDA_FIRST_PAGE ((size_t)-1)
+
+struct libcda_engine {
+	struct libcda_session * session;
+	CURLM * multi;
+	struct libcda_transfer * queue_head;
+	struct libcda_transfer * queue_tail;
+	struct libcda_transfer * running;
+	size_t running_count;
+	size_t concurrency;
+};
+
+static void free_transfer(struct libcda_transfer * i) {
+	if(i->page != NULL) free_memory_chunk(i->page);
+	free(i->url);
+	free(i);
+}
+
+static void fail_job(struct libcda_job * job, const int status) {
+	if(job->status == LIBCDA_STATUS_OK) job->status = status;
+}
+
+/* Tells on_url about url[index] of the draft as soon as it is decoded */
+static void report_url(const struct libcda_job * job, const size_t index) {
+	const struct results_draft * draft = &(job->draft);
+	if(job->on_url == NULL || draft->url[index] == RESULTS_DRAFT_NO_STRING) return;
+	job->on_url(draft->json_type == LIBCDA_VIDEO_IS_FILE ? draft_string(draft, draft->quality[index]) : NULL, draft_string(draft, draft->url[index]), LIBCDA_STATUS_OK, job->userdata);
+}
+
+static void report_cached_urls(const struct libcda_job * job) {
+	const struct cda_results * result = job->result;
+	size_t counter = 0;
+	if(job->on_url == NULL) return;
+	for(counter = 0; counter < result->url_count; ++counter) {
+		if(result->url[counter] != NULL) job->on_url(result->json_type == LIBCDA_VIDEO_IS_FILE ? result->quality[counter] : NULL, result->url[counter], LIBCDA_STATUS_OK, job->userdata);
+	}
+}
+
+static void complete_job(struct libcda_job * job) {
+	if(job->on_url != NULL) job->on_url(NULL, NULL, job->status, job->userdata);
+	free(job->preferred_quality);
+	job->preferred_quality = NULL;
+	free(job->cache_quality);
+	job->cache_quality = NULL;
+	free(job->page_url);
+	job->page_url = NULL;
+	job->stats.resolve_time = monotonic_nanoseconds() - job->started;
+	add_stats(&(job->session->stats), &(job->stats));
+	if(job->callback != NULL) {
+		job->callback(job->result, job->status, &(job->stats), job->userdata);
+		free(job);
+	}
+}
+
+static int attach_lazy_urls(struct libcda_job * job);
+static void settle_lazy_urls(struct libcda_job * job);
+
+/* A job that defers its qualities gets a lazy result unless nothing is
+ * missing. A job that resolves URLs of a lazy result puts them there. */
+static void finish_job(struct libcda_job * job) {
+	if(job->lazy_results != NULL) {
+		settle_lazy_urls(job);
+	} else if(job->status == LIBCDA_STATUS_OK) {
+		job->result = pack_results_draft(&(job->draft), job->defer_qualities);
+		if(job->result == NULL) fail_job(job, LIBCDA_STATUS_OUT_OF_MEMORY);
+		if(job->result != NULL && job->defer_qualities && attach_lazy_urls(job)) {
+			free(job->result);
+			job->result = NULL;
+			fail_job(job, LIBCDA_STATUS_OUT_OF_MEMORY);
+		}
+		if(job->result != NULL && job->result->lazy == NULL && job->cache != NULL) store_results(job->cache, job->video_id, job->cache_quality, job->result);
+		if(job->result != NULL && job->result->lazy == NULL && job->disk_cache != NULL) store_disk_results(job->disk_cache, job->video_id, job->cache_quality, job->result);
+	}
+	free_results_draft(&(job->draft));
+	free(job->video_id);
+	job->video_id = NULL;
+	free(job->player_id);
+	job->player_id = NULL;
+	complete_job(job);
+}
+
+static void finish_transfer(struct libcda_transfer * transfer) {
+	struct libcda_job * job = transfer->job;
+	free_transfer(transfer);
+	if(--job->pending) return;
+	finish_job(job);
+}
+
+/* Takes ownership of url. Pages of jobs that are already underway go to the
+ * front of the queue, so that started jobs finish before new ones begin. */
+static void queue_transfer(struct libcda_engine * engine, struct libcda_job * job, char * url, const size_t url_index) {
+	struct libcda_transfer * transfer = calloc(1, sizeof(struct libcda_transfer));
+	if(transfer == NULL) {
+		fprintf(stderr, "queue_transfer: could not allocate memory for transfer of URL %s.\n", url);
+		free(url);
+		fail_job(job, LIBCDA_STATUS_OUT_OF_MEMORY);
+		return;
+	}
+	transfer->job = job;
+	transfer->url = url;
+	transfer->url_index = url_index;
+	++job->pending;
+	if(url_index == LIBCDA_FIRST_PAGE) {
+		if(engine->queue_tail != NULL) engine->queue_tail->next = transfer;
+		else engine->queue_head = transfer;
+		engine->queue_tail = transfer;
+	} else {
+		transfer->next = engine->queue_head;
+		engine->queue_head = transfer;
+		if(engine->queue_tail == NULL) engine->queue_tail = transfer;
+	}
+}
+
+/* Stores the page like write_memory_callback does, but stops the download
+ * with a short write as soon as the player element is complete: the rest
+ * of the page is of no use to us. */
+/* Cutting a body short resets just the stream on HTTP/2, but closes the
+ * connection on HTTP/1.x. There the rest of the page is read when the
+ * server said how long it is and that rest is within the drain limit. */
+static int worth_draining(const struct libcda_transfer * transfer) {
+	long version = 0;
+	curl_off_t length = -1;
+	curl_off_t received = 0;
+	curl_easy_getinfo(transfer->curl, CURLINFO_HTTP_VERSION, &version);
+	if(version != CURL_HTTP_VERSION_1_1) return 0;
+	if(curl_easy_getinfo(transfer->curl, CURLINFO_CONTENT_LENGTH_DOWNLOAD_T, &length) != CURLE_OK || length < 0) return 0;
+	curl_easy_getinfo(transfer->curl, CURLINFO_SIZE_DOWNLOAD_T, &received);
+	return length - received <= transfer->job->session->drain_limit;
+}
+
+/* Once the player element is in, the rest of the page is either cut off
+ * or drained without being kept. */
+static size_t write_page_callback(char *contents, size_t size, size_t nmemb, void *userdata) {
+	struct libcda_transfer * transfer = (struct libcda_transfer *)userdata;
+	size_t result = size * nmemb;
+	if(transfer->draining) return result;
+	result = write_memory_callback(contents, size, nmemb, transfer->page);
+	if(scan_for_player_data(&(transfer->scanner), transfer->page)) {
+		if(worth_draining(transfer)) transfer->draining = 1;
+		else result = 0;
+	}
+	return result;
+}
+
+static void start_transfers(struct libcda_engine * engine) {
+	struct libcda_transfer * transfer = NULL;
+	while(engine->queue_head != NULL && (!engine->concurrency || engine->running_count < engine->concurrency)) {
+		transfer = engine->queue_head;
+		engine->queue_head = transfer->next;
+		if(engine->queue_head == NULL) engine->queue_tail = NULL;
+		transfer->next = NULL;
+
+		if(transfer->job->status != LIBCDA_STATUS_OK) {
+			finish_transfer(transfer);
+			continue;
+		}
+		transfer->page = new_memory_chunk();
+		if(transfer->page != NULL) {
+			transfer->scanner.needle = transfer->job->player_id;
+			transfer->scanner.needle_length = strlen(transfer->job->player_id);
+			transfer->curl = acquire_curl_handle(engine->session, transfer->url, write_page_callback, transfer);
+		}
+		if(transfer->curl == NULL) {
+			fprintf(stderr, "start_transfers: could not set up transfer of URL %s.\n", transfer->url);
+			fail_job(transfer->job, LIBCDA_STATUS_OUT_OF_MEMORY);
+			finish_transfer(transfer);
+			continue;
+		}
+		curl_easy_setopt(transfer->curl, CURLOPT_PRIVATE, transfer);
+		curl_multi_add_handle(engine->multi, transfer->curl);
+
+		transfer->next = engine->running;
+		if(engine->running != NULL) engine->running->previous = transfer;
+		engine->running = transfer;
+		++engine->running_count;
+	}
+}
+
+static size_t timed_get_url_from_json(const struct player_data * video, struct results_draft * draft, struct libcda_stats * stats) {
+	const uint64_t started = monotonic_nanoseconds();
+	const size_t result = get_url_from_json(video, draft);
+	stats->decode_time += monotonic_nanoseconds() - started;
+	return result;
+}
+
+/* Keeps only the quality the job prefers, which either is the default one
+ * or takes one more page. */
+static void accept_first_page_in_quality(struct libcda_engine * engine, struct libcda_job * job, struct libcda_transfer * transfer, const struct player_data * video, const size_t default_index) {
+	struct results_draft * draft = &(job->draft);
+	char * extra_url = NULL;
+	const size_t chosen = choose_draft_quality(draft, job->preference, job->preferred_quality);
+	if(chosen == draft->quality_count) {
+		fprintf(stderr, "libcda_get_url: no quality to go with %s.\n", job->cache_quality);
+		fail_job(job, LIBCDA_STATUS_NO_SUCH_QUALITY);
+		return;
+	}
+	draft->quality[0] = draft->quality[chosen];
+	draft->quality_count = 1;
+	draft->url_count = 1;
+	if(chosen == default_index) {
+		draft->url[0] = timed_get_url_from_json(video, draft, &(job->stats));
+		if(draft->url[0] == RESULTS_DRAFT_NO_STRING) fail_job(job, LIBCDA_STATUS_PARSING_FAILED);
+		else report_url(job, 0);
+		return;
+	}
+	extra_url = get_extra_url(transfer->url, draft_string(draft, draft->quality[0]));
+	if(extra_url == NULL) {
+		fprintf(stderr, "libcda_get_url: failed to get URL for %s.\n", draft_string(draft, draft->quality[0]));
+		fail_job(job, LIBCDA_STATUS_OUT_OF_MEMORY);
+		return;
+	}
+	queue_transfer(engine, job, extra_url, 0);
+}
+
+static void accept_first_page(struct libcda_engine * engine, struct libcda_job * job, struct libcda_transfer * transfer) {
+	const char * default_quality = NULL;
+	char * extra_url = NULL;
+	struct results_draft * draft = &(job->draft);
+	struct player_data video;
+	size_t counter = 0;
+	size_t default_index = 0;
+	char json_type = 0;
+
+	if(parse_player_data(&video, job->video_id, transfer->page, &(transfer->scanner), engine->session->json_parser, &(job->stats))) {
+		fail_job(job, LIBCDA_STATUS_PARSING_FAILED);
+		return;
+	}
+
+	json_type = determine_json_type(&video);
+	if(json_type == LIBCDA_VIDEO_NOT_SUPPORTED) {
+		fprintf(stderr, "libcda_get_url: JSON response does not contain any hints.\n");
+		fail_job(job, LIBCDA_STATUS_NOT_SUPPORTED);
+		free_player_data(&video);
+		return;
+	}
+	draft->json_type = json_type;
+
+	if(count_qualities(&video, draft)) {
+		fail_job(job, LIBCDA_STATUS_PARSING_FAILED);
+		free_player_data(&video);
+		return;
+	}
+
+	draft->url_count = json_type == LIBCDA_VIDEO_IS_FILE ? draft->quality_count : 1;
+	draft->url = malloc(draft->url_count * sizeof(size_t));
+	if(draft->url == NULL) {
+		fprintf(stderr, "libcda_get_url: could not allocate memory for URLs inside the result structure.\n");
+		draft->url_count = 0;
+		fail_job(job, LIBCDA_STATUS_OUT_OF_MEMORY);
+		free_player_data(&video);
+		return;
+	}
+	for(counter = 0; counter < draft->url_count; ++counter) draft->url[counter] = RESULTS_DRAFT_NO_STRING;
+
+	switch(json_type) {
+		case LIBCDA_VIDEO_IS_FILE:
+			default_quality = get_current_quality(&video);
+			if(default_quality == NULL) {
+				fail_job(job, LIBCDA_STATUS_PARSING_FAILED);
+				break;
+			}
+
+/* The page we already have only holds the URL of the default quality.
+ * Should that quality be missing from the list, every entry gets its own page. */
+			default_index = determine_quality_index(draft, default_quality);
+			if(job->preference != LIBCDA_QUALITY_ALL) {
+				accept_first_page_in_quality(engine, job, transfer, &video, default_index);
+				break;
+			}
+			if(default_index < draft->quality_count) {
+				draft->url[default_index] = timed_get_url_from_json(&video, draft, &(job->stats));
+				if(draft->url[default_index] == RESULTS_DRAFT_NO_STRING) {
+					fail_job(job, LIBCDA_STATUS_PARSING_FAILED);
+					break;
+				}
+				report_url(job, default_index);
+			}
+			if(job->defer_qualities) break;
+
+			for(counter = 0; counter < draft->quality_count && job->status == LIBCDA_STATUS_OK; ++counter) {
+				if(counter != default_index) {
+					extra_url = get_extra_url(transfer->url, draft_string(draft, draft->quality[counter]));
+					if(extra_url == NULL) {
+						fprintf(stderr, "libcda_get_url: failed to get URL for %s.\n", draft_string(draft, draft->quality[counter]));
+						fail_job(job, LIBCDA_STATUS_OUT_OF_MEMORY);
+					} else {
+						queue_transfer(engine, job, extra_url, counter);
+					}
+				}
+			}
+			break;
+
+		case LIBCDA_VIDEO_IS_M3U8:
+			draft->url[0] = get_m3u8_link(&video, draft);
+			if(draft->url[0] == RESULTS_DRAFT_NO_STRING) fail_job(job, LIBCDA_STATUS_PARSING_FAILED);
+			else report_url(job, 0);
+			break;
+	}
+
+	free_player_data(&video);
+}
+
+static void accept_extra_page(struct libcda_engine * engine, struct libcda_job * job, struct libcda_transfer * transfer) {
+	struct results_draft * draft = &(job->draft);
+	struct player_data video;
+
+	if(parse_player_data(&video, job->video_id, transfer->page, &(transfer->scanner), engine->session->json_parser, &(job->stats))) {
+		fprintf(stderr, "libcda_get_url: failed to get JSON for %s.\n", draft_string(draft, draft->quality[transfer->url_index]));
+		fail_job(job, LIBCDA_STATUS_PARSING_FAILED);
+		return;
+	}
+	draft->url[transfer->url_index] = timed_get_url_from_json(&video, draft, &(job->stats));
+	free_player_data(&video);
+	if(draft->url[transfer->url_index] == RESULTS_DRAFT_NO_STRING) {
+		fprintf(stderr, "libcda_get_url: failed to decode URL for %s.\n", draft_string(draft, draft->quality[transfer->url_index]));
+		fail_job(job, LIBCDA_STATUS_PARSING_FAILED);
+	} else {
+		report_url(job, transfer->url_index);
+	}
+}
+
+/* curl reports each phase as the time from the start of the transfer until
+ * that phase ended. A reused connection reports zero for the phases it
+ * skipped, so nothing is taken for those. */
+static unsigned long long curl_phase_time(CURL * curl, const CURLINFO phase_end, const curl_off_t phase_start) {
+	curl_off_t result = 0;
+	if(curl_easy_getinfo(curl, phase_end, &result) != CURLE_OK || result < phase_start) return 0;
+	return (unsigned long long)(result - phase_start) * 1000;
+}
+
+/* The bytes on the wire are counted before decoding and the page after */
+static void count_fetch(struct libcda_stats * stats, CURL * curl, const size_t url_index, const size_t page_size) {
+	curl_off_t name_lookup = 0;
+	curl_off_t connect = 0;
+	curl_off_t bytes = 0;
+	unsigned long long total = 0;
+	curl_easy_getinfo(curl, CURLINFO_NAMELOOKUP_TIME_T, &name_lookup);
+	curl_easy_getinfo(curl, CURLINFO_CONNECT_TIME_T, &connect);
+	if(curl_easy_getinfo(curl, CURLINFO_SIZE_DOWNLOAD_T, &bytes) == CURLE_OK) stats->bytes_downloaded += bytes;
+	stats->bytes_decoded += page_size;
+	++stats->fetches;
+	stats->quality_fetches += url_index != LIBCDA_FIRST_PAGE;
+	stats->dns_time += curl_phase_time(curl, CURLINFO_NAMELOOKUP_TIME_T, 0);
+	stats->connect_time += curl_phase_time(curl, CURLINFO_CONNECT_TIME_T, name_lookup);
+	stats->tls_time += curl_phase_time(curl, CURLINFO_APPCONNECT_TIME_T, connect);
+	stats->first_byte_time += curl_phase_time(curl, CURLINFO_STARTTRANSFER_TIME_T, 0);
+	total = curl_phase_time(curl, CURLINFO_TOTAL_TIME_T, 0);
+	stats->fetch_time += total;
+	if(stats->slowest_fetch_time < total) stats->slowest_fetch_time = total;
+}
+
+static void end_transfer(struct libcda_engine * engine, struct libcda_transfer * transfer, const CURLcode response) {
+	struct libcda_job * job = transfer->job;
+
+	if(transfer->previous != NULL) transfer->previous->next = transfer->next;
+	else engine->running = transfer->next;
+	if(transfer->next != NULL) transfer->next->previous = transfer->previous;
+	transfer->previous = NULL;
+	transfer->next = NULL;
+	--engine->running_count;
+	curl_multi_remove_handle(engine->multi, transfer->curl);
+	count_fetch(&(job->stats), transfer->curl, transfer->url_index, transfer->page->size);
+	release_curl_handle(engine->session, transfer->curl);
+	transfer->curl = NULL;
+
+	if(response != CURLE_OK && !(response == CURLE_WRITE_ERROR && transfer->scanner.state == PLAYER_SCANNER_DONE)) {
+		if(job->status == LIBCDA_STATUS_OK) fprintf(stderr, "curl_multi_perform() of URL %s failed: %s\n", transfer->url, curl_easy_strerror(response));
+		fail_job(job, LIBCDA_STATUS_DOWNLOAD_FAILED);
+	} else if(job->status == LIBCDA_STATUS_OK) {
+		if(transfer->url_index == LIBCDA_FIRST_PAGE) accept_first_page(engine, job, transfer);
+		else accept_extra_page(engine, job, transfer);
+	}
+	finish_transfer(transfer);
+}
+
+/* Ends every transfer there is, failing their jobs with status. */
+static void abort_engine(struct libcda_engine * engine, const int status) {
+	struct libcda_transfer * transfer = NULL;
+	for(transfer = engine->running; transfer != NULL; transfer = transfer->next) fail_job(transfer->job, status);
+	for(transfer = engine->queue_head; transfer != NULL; transfer = transfer->next) fail_job(transfer->job, status);
+	while(engine->running != NULL) end_transfer(engine, engine->running, CURLE_ABORTED_BY_CALLBACK);
+	while(engine->queue_head != NULL) {
+		transfer = engine->queue_head;
+		engine->queue_head = transfer->next;
+		finish_transfer(transfer);
+	}
+	engine->queue_tail = NULL;
+}
+
+/* Hands every transfer curl is done with to end_transfer. */
+static void collect_transfers(struct libcda_engine * engine) {
+	struct libcda_transfer * transfer = NULL;
+	CURLMsg * message = NULL;
+	int messages_left = 0;
+	while((message = curl_multi_info_read(engine->multi, &messages_left)) != NULL) {
+		if(message->msg == CURLMSG_DONE) {
+			curl_easy_getinfo(message->easy_handle, CURLINFO_PRIVATE, (char **)&transfer);
+			end_transfer(engine, transfer, message->data.result);
+		}
+	}
+}
+
+static void run_engine(struct libcda_engine * engine) {
+	CURLMcode multi_response = CURLM_OK;
+	int still_running = 0;
+
+	start_transfers(engine);
+	while(engine->running_count && multi_response == CURLM_OK) {
+		multi_response = curl_multi_perform(engine->multi, &still_running);
+		collect_transfers(engine);
+		start_transfers(engine);
+		if(engine->running_count && multi_response == CURLM_OK) {
+			multi_response = curl_multi_poll(engine->multi, NULL, 0, 1000, NULL);
+		}
+	}
 
-/* Write-only memory must be as big as biggest part_x */
-	char wom[16];
+	if(multi_response != CURLM_OK) {
+		fprintf(stderr, "run_engine: multi transfer failed: %s\n", curl_multi_strerror(multi_response));
+		abort_engine(engine, LIBCDA_STATUS_DOWNLOAD_FAILED);
+	}
+}
 
-	size_t * quality_lengths;
-	size_t * url_lengths;
-	size_t condition;
-	size_t the_most_important_allocation_succeeded;
+/* Memory first, then disk, which warms the memory cache when it hits */
+static struct cda_results * look_up_cached_results(struct libcda_job * job, const char * quality) {
+	struct cda_results * result = NULL;
+	if(job->cache != NULL) result = look_up_results(job->cache, job->video_id, quality);
+	if(result == NULL && job->disk_cache != NULL) {
+		result = look_up_disk_results(job->disk_cache, job->video_id, quality);
+		if(result != NULL && job->cache != NULL) store_results(job->cache, job->video_id, quality, result);
+	}
+	return result;
+}
 
-	const char * actual_json_type = known_json_types[(size_t)(i->json_type)];
-	const size_t actual_json_type_length = strlen(actual_json_type);
+/* Narrows a complete result down to the quality preference picks, so that
+ * a cached complete result answers preferences without another download. */
+static struct cda_results * results_in_quality(const struct cda_results * complete, const int preference, const char * wanted) {
+	struct cda_results narrow = *complete;
+	const size_t chosen = choose_quality((const char * const *)complete->quality, complete->quality_count, preference, wanted);
+	struct cda_results * result = NULL;
+	size_t size = 0;
+	if(complete->json_type == LIBCDA_VIDEO_IS_FILE) {
+		if(chosen == complete->quality_count || chosen >= complete->url_count || complete->url[chosen] == NULL) return NULL;
+		narrow.quality = complete->quality + chosen;
+		narrow.url = complete->url + chosen;
+		narrow.quality_count = 1;
+		narrow.url_count = 1;
+	}
+	size = libcda_results_size(&narrow);
+	result = malloc(size);
+	if(result == NULL) {
+		fprintf(stderr, "results_in_quality: could not allocate memory for results.\n");
+		return NULL;
+	}
+	return libcda_results_pack(&narrow, result, size);
+}
 
-	char * result;
-	char * dump_here;
-	size_t q_limit;
-	size_t u_limit;
-	size_t counter;
+/* A job that needs no transfer at all is completed right here, so with a
+ * callback it may be gone by the time this returns. */
+static void start_job(struct libcda_engine * engine, struct libcda_job * job, const char * cda_page_url) {
+	struct cda_results * complete_result = NULL;
+	char * first_url = NULL;
+	job->session = engine->session;
+	job->status = LIBCDA_STATUS_OK;
+	job->started = monotonic_nanoseconds();
+	job->stats.resolves = 1;
+	job->video_id = get_video_id(cda_page_url);
+	if(job->video_id == NULL) {
+		job->status = LIBCDA_STATUS_BAD_PAGE_URL;
+		complete_job(job);
+		return;
+	}
+	job->cache = engine->session->cache;
+	job->disk_cache = engine->session->disk_cache;
+	job->result = look_up_cached_results(job, job->cache_quality);
+	if(job->result == NULL && job->cache_quality != NULL) {
+		complete_result = look_up_cached_results(job, NULL);
+		if(complete_result != NULL) job->result = results_in_quality(complete_result, job->preference, job->preferred_quality);
+		libcda_free_get_url(complete_result);
+	}
+	if(job->result != NULL) {
+		report_cached_urls(job);
+		job->stats.cache_hits = 1;
+		free(job->video_id);
+		job->video_id = NULL;
+		complete_job(job);
+		return;
+	}
+	job->player_id = get_player_id(job->video_id);
+	first_url = strdup(cda_page_url);
+	if(job->player_id == NULL || first_url == NULL) {
+		fprintf(stderr, "start_job: could not allocate memory for URL %s.\n", cda_page_url);
+		job->status = LIBCDA_STATUS_OUT_OF_MEMORY;
+	} else {
+		queue_transfer(engine, job, first_url, LIBCDA_FIRST_PAGE);
+		first_url = NULL;
+	}
+	if(!job->pending) {
+		free(first_url);
+		free(job->player_id);
+		job->player_id = NULL;
+		free(job->video_id);
+		job->video_id = NULL;
+		complete_job(job);
+	}
+}
 
-/* Minimum length to store */
-	size_t length = part_0l + actual_json_type_length + part_1l + part_2l + part_3l;
+/* Lazy results come back after the first page, with the URL that page
+ * plays. The URLs of the other qualities are resolved when somebody asks
+ * for them, or by a thread of their own once prefetching starts. Their
+ * state is kept apart from the result block under a lock, as that thread
+ * fills them in while the caller may be reading. */
+#define LAZY_URL_PENDING	0
+#define LAZY_URL_RESOLVING	1
+#define LAZY_URL_READY		2
+
+struct libcda_lazy_urls {
+	pthread_mutex_t lock;
+	pthread_cond_t settled;
+	pthread_t prefetcher;
+	int prefetching;
+	/* The options of the session the results came from, for the prefetch */
+	struct libcda_cache * cache;
+	struct libcda_disk_cache * disk_cache;
+	int json_parser;
+	int http2;
+	int compression;
+	long drain_limit;
+	char * page_url;
+	char * video_id;
+	char ** urls;
+	char * states;
+};
 
-	quality_lengths = malloc(sizeof(size_t) * i->quality_count);
-	condition = -(quality_lengths != NULL);
-	q_limit = (i->quality_count & condition)|(0 & ~condition);
-	for(counter = 0; counter < q_limit; ++counter) {
-		quality_lengths[counter] = strlen(i->quality[counter]);
-		length += quality_lengths[counter];
+struct lazy_prefetch {
+	struct cda_results * results;
+	size_t * indices;
+	size_t count;
+};
+
+static void lock_lazy_urls(const struct cda_results * i) {
+	if(i->lazy != NULL) pthread_mutex_lock(&(i->lazy->lock));
+}
+
+static void unlock_lazy_urls(const struct cda_results * i) {
+	if(i->lazy != NULL) pthread_mutex_unlock(&(i->lazy->lock));
+}
+
+static void free_lazy_urls(struct cda_results * i) {
+	struct libcda_lazy_urls * lazy = i->lazy;
+	size_t counter = 0;
+	if(lazy->prefetching) pthread_join(lazy->prefetcher, NULL);
+	pthread_mutex_destroy(&(lazy->lock));
+	pthread_cond_destroy(&(lazy->settled));
+	for(counter = 0; counter < i->url_count; ++counter) free(lazy->urls[counter]);
+	free(lazy->urls);
+	free(lazy->states);
+	free(lazy->page_url);
+	free(lazy->video_id);
+	free(lazy);
+	i->lazy = NULL;
+}
+
+static int attach_lazy_urls(struct libcda_job * job) {
+	struct cda_results * results = job->result;
+	struct libcda_lazy_urls * lazy = NULL;
+	size_t counter = 0;
+	while(counter < results->url_count && results->url[counter] != NULL) ++counter;
+	if(counter == results->url_count) return 0;
+	lazy = calloc(1, sizeof(struct libcda_lazy_urls));
+	if(lazy == NULL) {
+		fprintf(stderr, "attach_lazy_urls: could not allocate memory.\n");
+		return 1;
 	}
-	length += (q_limit << 1);
-	condition = -(q_limit > 1);
-	length += ((q_limit - 1) & condition)|(0 & ~condition);
+	lazy->urls = calloc(results->url_count, sizeof(char *));
+	lazy->states = calloc(results->url_count, 1);
+	lazy->page_url = strdup(job->page_url);
+	lazy->video_id = strdup(job->video_id);
+	lazy->cache = job->session->cache;
+	lazy->disk_cache = job->session->disk_cache;
+	lazy->json_parser = job->session->json_parser;
+	lazy->http2 = job->session->http2;
+	lazy->compression = job->session->compression;
+	lazy->drain_limit = job->session->drain_limit;
+	if(lazy->urls == NULL || lazy->states == NULL || lazy->page_url == NULL || lazy->video_id == NULL) {
+		fprintf(stderr, "attach_lazy_urls: could not allocate memory.\n");
+		free(lazy->urls);
+		free(lazy->states);
+		free(lazy->page_url);
+		free(lazy->video_id);
+		free(lazy);
+		return 1;
+	}
+	for(counter = 0; counter < results->url_count; ++counter) {
+		if(results->url[counter] != NULL) lazy->states[counter] = LAZY_URL_READY;
+	}
+	pthread_mutex_init(&(lazy->lock), NULL);
+	pthread_cond_init(&(lazy->settled), NULL);
+	results->lazy = lazy;
+	return 0;
+}
 
-	url_lengths = malloc(sizeof(size_t) * i->url_count);
-	condition = -(url_lengths != NULL);
-	u_limit = (i->url_count & condition)|(0 & ~condition);
-	for(counter = 0; counter < u_limit; ++counter) {
-		url_lengths[counter] = strlen(i->url[counter]);
-		length += url_lengths[counter];
+/* URLs that could not be had go back to pending for the next one asking. */
+static void settle_lazy_urls(struct libcda_job * job) {
+	struct cda_results * results = job->lazy_results;
+	struct libcda_lazy_urls * lazy = results->lazy;
+	char * url = NULL;
+	size_t index = 0;
+	size_t counter = 0;
+	pthread_mutex_lock(&(lazy->lock));
+	for(counter = 0; counter < job->lazy_count; ++counter) {
+		index = job->lazy_indices[counter];
+		url = job->draft.url != NULL && job->draft.url[index] != RESULTS_DRAFT_NO_STRING ? strdup(draft_string(&(job->draft), job->draft.url[index])) : NULL;
+		lazy->urls[index] = url;
+		results->url[index] = url;
+		lazy->states[index] = url != NULL ? LAZY_URL_READY : LAZY_URL_PENDING;
 	}
-	length += (u_limit << 1);
-	condition = -(u_limit > 1);
-	length += ((u_limit - 1) & condition)|(0 & ~condition);
+	pthread_cond_broadcast(&(lazy->settled));
+	pthread_mutex_unlock(&(lazy->lock));
+}
 
-/* Copy: {"json_type":"
-*/	result = malloc(length);
-	the_most_important_allocation_succeeded = -(result != NULL);
-	dump_here = (char *)(((size_t)result & the_most_important_allocation_succeeded)|((size_t)wom & ~the_most_important_allocation_succeeded));
-	memcpy(dump_here, part_0, part_0l);
-	dump_here += (part_0l & the_most_important_allocation_succeeded)|(0 & ~the_most_important_allocation_succeeded);
+/* The job starts at the pages of the qualities, which the caller has
+ * marked as resolving. */
+static void start_lazy_job(struct libcda_engine * engine, struct libcda_job * job) {
+	const struct cda_results * results = job->lazy_results;
+	struct results_draft * draft = &(job->draft);
+	char * string = NULL;
+	char * extra_url = NULL;
+	size_t length = 0;
+	size_t counter = 0;
+	job->session = engine->session;
+	job->status = LIBCDA_STATUS_OK;
+	job->started = monotonic_nanoseconds();
+	job->video_id = strdup(results->lazy->video_id);
+	job->player_id = job->video_id != NULL ? get_player_id(job->video_id) : NULL;
+	draft->quality = malloc(results->quality_count * sizeof(size_t));
+	draft->url = malloc(results->url_count * sizeof(size_t));
+	if(job->player_id == NULL || draft->quality == NULL || draft->url == NULL) {
+		fprintf(stderr, "start_lazy_job: could not allocate memory.\n");
+		fail_job(job, LIBCDA_STATUS_OUT_OF_MEMORY);
+	}
+	for(counter = 0; counter < results->quality_count && job->status == LIBCDA_STATUS_OK; ++counter) {
+		length = strlen(results->quality[counter]) + 1;
+		string = reserve_draft_strings(draft, length);
+		if(string == NULL) {
+			fail_job(job, LIBCDA_STATUS_OUT_OF_MEMORY);
+			break;
+		}
+		memcpy(string, results->quality[counter], length);
+		draft->quality[counter] = draft->strings_size;
+		draft->strings_size += length;
+		++draft->quality_count;
+	}
+	for(counter = 0; draft->url != NULL && counter < results->url_count; ++counter) draft->url[counter] = RESULTS_DRAFT_NO_STRING;
+	draft->url_count = draft->url != NULL ? results->url_count : 0;
+	for(counter = 0; counter < job->lazy_count && job->status == LIBCDA_STATUS_OK; ++counter) {
+		extra_url = get_extra_url(results->lazy->page_url, results->quality[job->lazy_indices[counter]]);
+		if(extra_url == NULL) fail_job(job, LIBCDA_STATUS_OUT_OF_MEMORY);
+		else queue_transfer(engine, job, extra_url, job->lazy_indices[counter]);
+	}
+	if(!job->pending) finish_job(job);
+}
 
-/* Copy: json_type
-*/	memcpy(dump_here, actual_json_type, actual_json_type_length);
-	dump_here += (actual_json_type_length & the_most_important_allocation_succeeded)|(0 & ~the_most_important_allocation_succeeded);
+static void resolve_lazy_urls(struct libcda_session * session, struct cda_results * results, const size_t * indices, const size_t count) {
+	struct libcda_engine engine = {0};
+	struct libcda_job job = {0};
+	engine.session = session;
+	engine.multi = session->multi;
+	job.lazy_results = results;
+	job.lazy_indices = indices;
+	job.lazy_count = count;
+	start_lazy_job(&engine, &job);
+	run_engine(&engine);
+}
 
-/* Copy: ","qualities":[
-*/	memcpy(dump_here, part_1, part_1l);
-	dump_here += (part_1l & the_most_important_allocation_succeeded)|(0 & ~the_most_important_allocation_succeeded);
+static void * prefetch_lazy_urls(void * argument) {
+	struct lazy_prefetch * prefetch = argument;
+	const struct libcda_lazy_urls * lazy = prefetch->results->lazy;
+	struct libcda_session * session = libcda_session_create();
+	struct libcda_job job = {0};
+	if(session != NULL) {
+		libcda_session_setopt(session, LIBCDA_OPT_CACHE, lazy->cache);
+		libcda_session_setopt(session, LIBCDA_OPT_DISK_CACHE, lazy->disk_cache);
+		libcda_session_setopt(session, LIBCDA_OPT_JSON_PARSER, (long)lazy->json_parser);
+		libcda_session_setopt(session, LIBCDA_OPT_HTTP2, (long)lazy->http2);
+		libcda_session_setopt(session, LIBCDA_OPT_COMPRESSION, (long)lazy->compression);
+		libcda_session_setopt(session, LIBCDA_OPT_DRAIN_LIMIT, lazy->drain_limit);
+		resolve_lazy_urls(session, prefetch->results, prefetch->indices, prefetch->count);
+	} else {
+		job.lazy_results = prefetch->results;
+		job.lazy_indices = prefetch->indices;
+		job.lazy_count = prefetch->count;
+		settle_lazy_urls(&job);
+	}
+	libcda_session_destroy(session);
+	free(prefetch->indices);
+	free(prefetch);
+	return NULL;
+}
 
-/* Copy: qualities from json
-*/	for(counter = 0; counter < q_limit; ++counter) {
-		(dump_here++)[0] = '"';
-		memcpy(dump_here, i->quality[counter], quality_lengths[counter]);
-		dump_here += quality_lengths[counter];
-		(dump_here++)[0] = '"';
-		condition = -(counter + 1 < q_limit);
-		dump_here[0] = (',' & condition)|(dump_here[0] & ~condition);
-		dump_here += !!condition;
+/* Hands out url[index] of results, resolving it first with session if it
+ * is not there yet, or waiting for the prefetch that is at it. NULL
+ * stands for the default session of the calling thread. Returns NULL when
+ * the URL cannot be had. */
+const char * libcda_results_url(struct libcda_session * session, struct cda_results * results, const size_t index) {
+	struct libcda_lazy_urls * lazy = NULL;
+	const char * result = NULL;
+	if(results == NULL || index >= results->url_count) return NULL;
+	lazy = results->lazy;
+	if(lazy == NULL) return results->url[index];
+	pthread_mutex_lock(&(lazy->lock));
+	while(lazy->states[index] == LAZY_URL_RESOLVING) pthread_cond_wait(&(lazy->settled), &(lazy->lock));
+	if(lazy->states[index] == LAZY_URL_PENDING) {
+		if(session == NULL) session = get_default_session();
+		if(session != NULL) {
+			lazy->states[index] = LAZY_URL_RESOLVING;
+			pthread_mutex_unlock(&(lazy->lock));
+			resolve_lazy_urls(session, results, &index, 1);
+			pthread_mutex_lock(&(lazy->lock));
+		}
 	}
-	free(quality_lengths);
+	result = results->url[index];
+	pthread_mutex_unlock(&(lazy->lock));
+	return result;
+}
 
-/* Copy: part_2
-*/	memcpy(dump_here, part_2, part_2l);
-	dump_here += (part_2l & the_most_important_allocation_succeeded)|(0 & ~the_most_important_allocation_succeeded);
+/* Starts a thread with a session of its own that resolves every URL of
+ * results nobody has asked for yet. That session is set up like the one
+ * the results came from, so its caches must outlive the prefetch. Until it
+ * is done, url entries are to be read with libcda_results_url only.
+ * libcda_free_get_url waits for it. */
+int libcda_results_prefetch(struct cda_results * results) {
+	struct libcda_lazy_urls * lazy = NULL;
+	struct lazy_prefetch * prefetch = NULL;
+	size_t counter = 0;
+	if(results == NULL || results->lazy == NULL) return 0;
+	lazy = results->lazy;
+	prefetch = calloc(1, sizeof(struct lazy_prefetch));
+	if(prefetch == NULL || (prefetch->indices = malloc(results->url_count * sizeof(size_t))) == NULL) {
+		fprintf(stderr, "libcda_results_prefetch: could not allocate memory.\n");
+		free(prefetch);
+		return 1;
+	}
+	prefetch->results = results;
+	pthread_mutex_lock(&(lazy->lock));
+	if(lazy->prefetching) {
+		pthread_mutex_unlock(&(lazy->lock));
+		free(prefetch->indices);
+		free(prefetch);
+		return 0;
+	}
+	for(counter = 0; counter < results->url_count; ++counter) {
+		if(lazy->states[counter] == LAZY_URL_PENDING) prefetch->indices[prefetch->count++] = counter;
+	}
+	if(!prefetch->count || pthread_create(&(lazy->prefetcher), NULL, prefetch_lazy_urls, prefetch)) {
+		pthread_mutex_unlock(&(lazy->lock));
+		if(prefetch->count) fprintf(stderr, "libcda_results_prefetch: could not start a thread.\n");
+		counter = prefetch->count;
+		free(prefetch->indices);
+		free(prefetch);
+		return counter != 0;
+	}
+	for(counter = 0; counter < prefetch->count; ++counter) lazy->states[prefetch->indices[counter]] = LAZY_URL_RESOLVING;
+	lazy->prefetching = 1;
+	pthread_mutex_unlock(&(lazy->lock));
+	return 0;
+}
 
-/* Copy: urls from json
-*/	for(counter = 0; counter < u_limit; ++counter) {
-		(dump_here++)[0] = '"';
-		memcpy(dump_here, i->url[counter], url_lengths[counter]);
-		dump_here += url_lengths[counter];
-		(dump_here++)[0] = '"';
-		condition = -(counter + 1 < u_limit);
-		dump_here[0] = (',' & condition)|(dump_here[0] & ~condition);
-		dump_here += !!condition;
+/* Like libcda_session_get_url, but done after the first page. The result
+ * has every quality and the URL of the quality that page plays, while the
+ * other url entries are NULL until libcda_results_url resolves them. */
+struct cda_results * libcda_session_get_url_lazily(struct libcda_session * session, const char * cda_page_url, int * status) {
+	struct libcda_engine engine = {0};
+	struct libcda_job job = {0};
+	engine.session = session;
+	engine.multi = session->multi;
+	job.defer_qualities = 1;
+	job.page_url = strdup(cda_page_url);
+	if(job.page_url == NULL) {
+		fprintf(stderr, "libcda_get_url_lazily: could not allocate memory for URL %s.\n", cda_page_url);
+		if(status != NULL) *status = LIBCDA_STATUS_OUT_OF_MEMORY;
+		return NULL;
 	}
-	free(url_lengths);
+	start_job(&engine, &job, cda_page_url);
+	run_engine(&engine);
+	if(status != NULL) *status = job.status;
+	return job.result;
+}
 
-/* Copy: ]}\0
-*/	memcpy(dump_here, part_3, part_3l);
+/* Like libcda_session_get_url, calling on_url with every quality and URL as
+ * soon as it is decoded: the quality the first page plays comes first, the
+ * others as their pages arrive. quality is NULL for an m3u8 playlist, which
+ * serves them all. A last call with NULL for both and the status of the
+ * resolve ends it. The strings point into the draft, which grows as pages
+ * arrive, so on_url has to copy what it keeps. */
+struct cda_results * libcda_session_get_url_progressively(struct libcda_session * session, const char * cda_page_url, libcda_url_callback on_url, void * userdata, int * status) {
+	struct libcda_engine engine = {0};
+	struct libcda_job job = {0};
+	engine.session = session;
+	engine.multi = session->multi;
+	job.on_url = on_url;
+	job.userdata = userdata;
+	start_job(&engine, &job, cda_page_url);
+	run_engine(&engine);
+	if(status != NULL) *status = job.status;
+	return job.result;
+}
 
-/* This memset will ensure, that even if result was wom all this time,
- * no garbage will be printed. */
-	memset(wom, 0, 16);
-	puts(result);
-	free(result);
+struct cda_results * libcda_get_url_progressively(const char * cda_page_url, libcda_url_callback on_url, void * userdata, int * status) {
+	struct libcda_session * session = get_default_session();
+	if(session == NULL) return NULL;
+	return libcda_session_get_url_progressively(session, cda_page_url, on_url, userdata, status);
 }
 
-struct cda_results * libcda_get_url(const char * cda_page_url) {
-	const char * default_quality = NULL;
-	char * video_id = NULL;
-	char * extra_url = NULL;
-	struct cda_results * result = NULL;
-	struct json_object * big_json = NULL;
-	struct json_object * small_json = NULL;
+struct cda_results * libcda_get_url_lazily(const char * cda_page_url, int * status) {
+	struct libcda_session * session = get_default_session();
+	if(session == NULL) return NULL;
+	return libcda_session_get_url_lazily(session, cda_page_url, status);
+}
+
+/* Sets a job up to resolve only the quality preference picks */
+static int prefer_quality(struct libcda_job * job, const int preference, const char * quality) {
+	job->preference = preference;
+	if(preference == LIBCDA_QUALITY_ALL) return 0;
+	if(quality == NULL) quality = "";
+	job->preferred_quality = strdup(quality);
+	job->cache_quality = preference_cache_key(preference, quality);
+	if(job->preferred_quality != NULL && job->cache_quality != NULL) return 0;
+	free(job->preferred_quality);
+	job->preferred_quality = NULL;
+	free(job->cache_quality);
+	job->cache_quality = NULL;
+	return 1;
+}
+
+void libcda_free_get_urls(struct cda_results ** i, const size_t count) {
+	size_t counter = 0;
+	if(i != NULL) {
+		for(counter = 0; counter < count; ++counter) libcda_free_get_url(i[counter]);
+	}
+	free(i);
+}
+
+/* stats, when not NULL, gets one entry per page URL */
+static struct cda_results ** get_urls(struct libcda_session * session, const char * const * cda_page_urls, const size_t count, const size_t concurrency, int * statuses, struct libcda_stats * stats, const int preference, const char * quality) {
+	struct libcda_engine engine = {0};
+	struct libcda_job * jobs = NULL;
+	struct cda_results ** result = NULL;
 	size_t counter = 0;
-	size_t escape_counter = 0;
-	size_t default_index = 0;
-	char json_type = 0;
 
-	video_id = get_video_id(cda_page_url);
-	if(video_id == NULL) {
+	jobs = calloc(count, sizeof(struct libcda_job));
+	result = calloc(count, sizeof(struct cda_results *));
+	if((jobs == NULL || result == NULL) && count) {
+		fprintf(stderr, "libcda_get_urls: could not allocate memory for %zu jobs.\n", count);
+		free(jobs);
+		free(result);
 		return NULL;
 	}
 
-	big_json = get_big_json(cda_page_url, video_id);
-	if(big_json == NULL) {
-		free(video_id);
-		return NULL;
+	engine.session = session;
+	engine.multi = session->multi;
+	engine.concurrency = concurrency;
+	for(counter = 0; counter < count; ++counter) {
+		if(prefer_quality(jobs + counter, preference, quality)) {
+			jobs[counter].status = LIBCDA_STATUS_OUT_OF_MEMORY;
+			continue;
+		}
+		start_job(&engine, jobs + counter, cda_page_urls[counter]);
 	}
+	run_engine(&engine);
 
-	small_json = find_small_json(big_json);
-	if(small_json == NULL) {
-		free(video_id);
-		json_object_put(big_json);
-		return NULL;
+	for(counter = 0; counter < count; ++counter) {
+		result[counter] = jobs[counter].result;
+		if(statuses != NULL) statuses[counter] = jobs[counter].status;
+		if(stats != NULL) stats[counter] = jobs[counter].stats;
 	}
+	free(jobs);
+	return result;
+}
 
-	json_type = determine_json_type(small_json);
-	if(json_type == LIBCDA_VIDEO_NOT_SUPPORTED) {
-		fprintf(stderr, "libcda_get_url: JSON response does not contain any hints.\n");
-		free(video_id);
-		json_object_put(big_json);
-		return NULL;
+struct cda_results ** libcda_session_get_urls_with_stats(struct libcda_session * session, const char * const * cda_page_urls, const size_t count, const size_t concurrency, int * statuses, struct libcda_stats * stats) {
+	return get_urls(session, cda_page_urls, count, concurrency, statuses, stats, LIBCDA_QUALITY_ALL, NULL);
+}
+
+struct cda_results ** libcda_session_get_urls(struct libcda_session * session, const char * const * cda_page_urls, const size_t count, const size_t concurrency, int * statuses) {
+	return get_urls(session, cda_page_urls, count, concurrency, statuses, NULL, LIBCDA_QUALITY_ALL, NULL);
+}
+
+struct cda_results ** libcda_get_urls(const char * const * cda_page_urls, const size_t count, const size_t concurrency, int * statuses) {
+	struct libcda_session * session = get_default_session();
+	if(session == NULL) return NULL;
+	return libcda_session_get_urls(session, cda_page_urls, count, concurrency, statuses);
+}
+
+struct cda_results * libcda_session_get_url_with_stats(struct libcda_session * session, const char * cda_page_url, struct libcda_stats * stats) {
+	struct cda_results ** results = NULL;
+	struct cda_results * result = NULL;
+	results = get_urls(session, &cda_page_url, 1, 0, NULL, stats, LIBCDA_QUALITY_ALL, NULL);
+	if(results != NULL) {
+		result = results[0];
+		free(results);
+	}
+	return result;
+}
+
+struct cda_results * libcda_session_get_url(struct libcda_session * session, const char * cda_page_url) {
+	return libcda_session_get_url_with_stats(session, cda_page_url, NULL);
+}
+
+/* preference is one of LIBCDA_QUALITY_*. quality names the quality for
+ * LIBCDA_QUALITY_EXACT, the tallest one to accept for
+ * LIBCDA_QUALITY_AT_MOST, and is ignored otherwise. A video that is a file
+ * then has just the one quality and URL in its result, which takes one
+ * page, or two when it is not the quality the first page plays. */
+struct cda_results * libcda_session_get_url_in_quality(struct libcda_session * session, const char * cda_page_url, const int preference, const char * quality, int * status) {
+	struct cda_results ** results = NULL;
+	struct cda_results * result = NULL;
+	int own_status = LIBCDA_STATUS_OK;
+	results = get_urls(session, &cda_page_url, 1, 0, &own_status, NULL, preference, quality);
+	if(results != NULL) {
+		result = results[0];
+		free(results);
+	} else {
+		own_status = LIBCDA_STATUS_OUT_OF_MEMORY;
 	}
+	if(status != NULL) *status = own_status;
+	return result;
+}
+
+struct cda_results * libcda_get_url_in_quality(const char * cda_page_url, const int preference, const char * quality, int * status) {
+	struct libcda_session * session = get_default_session();
+	if(session == NULL) return NULL;
+	return libcda_session_get_url_in_quality(session, cda_page_url, preference, quality, status);
+}
+
+struct cda_results * libcda_get_url(const char * cda_page_url) {
+	struct libcda_session * session = get_default_session();
+	if(session == NULL) return NULL;
+	return libcda_session_get_url(session, cda_page_url);
+}
+
+/* The asynchronous interface runs the same engine, only curl does not wait
+ * for sockets itself: it tells the caller which ones to watch and when to
+ * time out, and the caller comes back with libcda_async_perform once
+ * something happened. The multi handle is its own so that the session can
+ * still be used the blocking way in between. */
+struct libcda_async {
+	struct libcda_engine engine;
+	libcda_socket_callback on_socket;
+	libcda_timer_callback on_timer;
+	void * userdata;
+};
+
+/* LIBCDA_POLL_* have the values of CURL_POLL_*, so what goes straight through */
+static int forward_socket(CURL * curl, curl_socket_t fd, int what, void * userdata, void * socket_data) {
+	struct libcda_async * async = (struct libcda_async *)userdata;
+	(void)curl;
+	(void)socket_data;
+	async->on_socket(fd, what, async->userdata);
+	return 0;
+}
+
+static int forward_timer(CURLM * multi, long timeout, void * userdata) {
+	struct libcda_async * async = (struct libcda_async *)userdata;
+	(void)multi;
+	async->on_timer(timeout, async->userdata);
+	return 0;
+}
 
-	result = malloc(sizeof(struct cda_results));
+/* Takes the HTTP/2 setting the session has now */
+struct libcda_async * libcda_async_create(struct libcda_session * session, const size_t concurrency, libcda_socket_callback on_socket, libcda_timer_callback on_timer, void * userdata) {
+	struct libcda_async * result = NULL;
+	if(session == NULL) session = get_default_session();
+	if(session == NULL || on_socket == NULL || on_timer == NULL) {
+		fprintf(stderr, "libcda_async_create: a session and both callbacks are needed.\n");
+		return NULL;
+	}
+	result = calloc(1, sizeof(struct libcda_async));
 	if(result == NULL) {
-		fprintf(stderr, "libcda_get_url: could not allocate memory for result structure.\n");
-		free(video_id);
-		json_object_put(big_json);
+		fprintf(stderr, "libcda_async_create: could not allocate memory.\n");
 		return NULL;
 	}
-	result->quality = NULL;
-	result->quality_count = 0;
-	result->url_count = 0;
-	result->json_type = json_type;
-
-	result->quality = count_qualities(small_json, &(result->quality_count), json_type);
-	if(result->quality == NULL) {
-		free(video_id);
-		json_object_put(big_json);
+	result->engine.session = session;
+	result->engine.concurrency = concurrency;
+	result->engine.multi = curl_multi_init();
+	if(result->engine.multi == NULL) {
+		fprintf(stderr, "libcda_async_create: could not initialize HTTP engine.\n");
 		free(result);
 		return NULL;
 	}
+	result->on_socket = on_socket;
+	result->on_timer = on_timer;
+	result->userdata = userdata;
+	curl_multi_setopt(result->engine.multi, CURLMOPT_SOCKETFUNCTION, forward_socket);
+	curl_multi_setopt(result->engine.multi, CURLMOPT_SOCKETDATA, result);
+	curl_multi_setopt(result->engine.multi, CURLMOPT_TIMERFUNCTION, forward_timer);
+	curl_multi_setopt(result->engine.multi, CURLMOPT_TIMERDATA, result);
+	curl_multi_setopt(result->engine.multi, CURLMOPT_PIPELINING, session_pipelining(session));
+	return result;
+}
 
-	switch(json_type) {
-		case LIBCDA_VIDEO_IS_FILE:
-			result->url_count = result->quality_count;
-			result->url = malloc(result->url_count * sizeof(char *));
-			if(result->url == NULL) {
-				fprintf(stderr, "libcda_get_url: could not allocate memory for URLs inside the result structure.\n");
-				free(result->quality);
-				free(video_id);
-				json_object_put(big_json);
-				free(result);
-				return NULL;
-			}
+/* Jobs still underway end with LIBCDA_STATUS_CANCELLED. */
+void libcda_async_destroy(struct libcda_async * async) {
+	if(async == NULL) return;
+	abort_engine(&(async->engine), LIBCDA_STATUS_CANCELLED);
+	curl_multi_cleanup(async->engine.multi);
+	free(async);
+}
 
-			default_quality = get_current_quality(small_json);
-			if(default_quality == NULL) {
-				free(result->quality);
-				free(video_id);
-				json_object_put(big_json);
-				free(result);
-				return NULL;
-			}
+/* on_result gets the result, which is then the caller's to free, the status
+ * and the stats of the resolve. It may run before this returns, for one
+ * when the result was cached. */
+static int start_async_job(struct libcda_async * async, const char * cda_page_url, libcda_url_callback on_url, libcda_result_callback on_result, void * userdata) {
+	struct libcda_job * job = NULL;
+	if(on_result == NULL) {
+		fprintf(stderr, "libcda_async_get_url: a result callback is needed.\n");
+		return 1;
+	}
+	job = calloc(1, sizeof(struct libcda_job));
+	if(job == NULL) {
+		fprintf(stderr, "libcda_async_get_url: could not allocate memory for URL %s.\n", cda_page_url);
+		return 1;
+	}
+	job->callback = on_result;
+	job->on_url = on_url;
+	job->userdata = userdata;
+	start_job(&(async->engine), job, cda_page_url);
+	start_transfers(&(async->engine));
+	return 0;
+}
 
-			default_index = determine_quality_index(result->quality, result->quality_count, default_quality);
-			result->url[default_index] = get_url_from_json(small_json);
-			json_object_put(big_json);
+int libcda_async_get_url(struct libcda_async * async, const char * cda_page_url, libcda_result_callback on_result, void * userdata) {
+	return start_async_job(async, cda_page_url, NULL, on_result, userdata);
+}
 
-			for(; counter < result->quality_count; ++counter) {
-				if(counter != default_index) {
-					extra_url = get_extra_url(cda_page_url, result->quality[counter]);
-					if(extra_url == NULL) {
-						fprintf(stderr, "libcda_get_url: failed to get URL for %s.\n", result->quality[counter]);
-						while(escape_counter < counter) {
-							free(result->url[escape_counter++]);
-						}
-						for(escape_counter = 0; escape_counter < result->quality_count; ++escape_counter) {
-							free(result->quality[escape_counter]);
-						}
-						free(result);
-						free(video_id);
-						return NULL;
-					}
+/* Like libcda_async_get_url, with on_url called as for
+ * libcda_session_get_url_progressively before on_result. */
+int libcda_async_get_url_progressively(struct libcda_async * async, const char * cda_page_url, libcda_url_callback on_url, libcda_result_callback on_result, void * userdata) {
+	return start_async_job(async, cda_page_url, on_url, on_result, userdata);
+}
 
-					big_json = get_big_json(extra_url, video_id);
-					free(extra_url);
-					if(big_json == NULL) {
-						fprintf(stderr, "libcda_get_url: failed to get JSON for %s.\n", result->quality[counter]);
-						while(escape_counter < counter) {
-							free(result->url[escape_counter++]);
-						}
-						for(escape_counter = 0; escape_counter < result->quality_count; ++escape_counter) {
-							free(result->quality[escape_counter]);
-						}
-						free(result);
-						free(video_id);
-						return NULL;
-					}
-					small_json = find_small_json(big_json);
-					result->url[counter] = get_url_from_json(small_json);
-					if(result->url[counter] == NULL) {
-						fprintf(stderr, "libcda_get_url: failed to decode URL for %s.\n", result->quality[counter]);
-						while(escape_counter < counter) {
-							free(result->url[escape_counter++]);
-						}
-						for(escape_counter = 0; escape_counter < result->quality_count; ++escape_counter) {
-							free(result->quality[escape_counter]);
-						}
-						free(result);
-						free(video_id);
-						json_object_put(big_json);
-						return NULL;
-					}
-					json_object_put(big_json);
-				}
-			}
-			break;
+/* fd is a socket on_socket asked to watch and events what happened on it,
+ * or fd is LIBCDA_SOCKET_TIMEOUT when the time on_timer asked for is up.
+ * Returns how many transfers are still running, or -1 when the engine
+ * broke down, in which case every job has been failed. */
+int libcda_async_perform(struct libcda_async * async, const int fd, const int events) {
+	struct libcda_engine * engine = &(async->engine);
+	CURLMcode multi_response = CURLM_OK;
+	int still_running = 0;
+	multi_response = curl_multi_socket_action(engine->multi, fd == LIBCDA_SOCKET_TIMEOUT ? CURL_SOCKET_TIMEOUT : fd, events, &still_running);
+	collect_transfers(engine);
+	start_transfers(engine);
+	if(multi_response != CURLM_OK) {
+		fprintf(stderr, "libcda_async_perform: multi transfer failed: %s\n", curl_multi_strerror(multi_response));
+		abort_engine(engine, LIBCDA_STATUS_DOWNLOAD_FAILED);
+		return -1;
+	}
+	return engine->running_count;
+}
 
-		case LIBCDA_VIDEO_IS_M3U8:
-			result->url_count = 1;
-			result->url = malloc(sizeof(char *));
-			if(result->url == NULL) {
-				fprintf(stderr, "libcda_get_url: failed to allocate memory for m3u8 link container.\n");
-				for(escape_counter = 0; escape_counter < result->quality_count; ++escape_counter) {
-					free(result->quality[escape_counter]);
-				}
-				free(result->quality);
-				free(result);
-				free(video_id);
-				json_object_put(big_json);
-			}
-			result->url[0] = get_m3u8_link(small_json);
-			if(result->url[0] == NULL) {
-				free(result->url);
-				for(escape_counter = 0; escape_counter < result->quality_count; ++escape_counter) {
-					free(result->quality[escape_counter]);
-				}
-				free(result->quality);
-				free(result);
-				free(video_id);
-				json_object_put(big_json);
-			}
-			json_object_put(big_json);
-			break;
+/* Parsing without fetching, for callers that do their own I/O. A parse is
+ * a job whose transfers are never started: the pages it would queue are
+ * handed to the caller as URLs instead, and the caller comes back with
+ * what they serve. Its settings session only lends the job its options. */
+struct libcda_parse {
+	struct libcda_session settings;
+	struct libcda_engine engine;
+	struct libcda_job job;
+	char * page_url;
+	char ** missing_urls;
+	int has_first_page;
+};
+
+void libcda_parse_destroy(struct libcda_parse * parse) {
+	size_t counter = 0;
+	if(parse == NULL) return;
+	for(counter = 0; parse->missing_urls != NULL && counter < parse->job.draft.url_count; ++counter) free(parse->missing_urls[counter]);
+	free(parse->missing_urls);
+	free_results_draft(&(parse->job.draft));
+	free(parse->job.video_id);
+	free(parse->job.player_id);
+	free(parse->page_url);
+	free(parse);
+}
+
+/* cda_page_url is the address of the first page, which the addresses of
+ * the other pages are made from. */
+struct libcda_parse * libcda_parse_create(const char * cda_page_url) {
+	struct libcda_parse * result = calloc(1, sizeof(struct libcda_parse));
+	if(result == NULL) {
+		fprintf(stderr, "libcda_parse_create: could not allocate memory.\n");
+		return NULL;
+	}
+	result->job.video_id = get_video_id(cda_page_url);
+	if(result->job.video_id == NULL) {
+		libcda_parse_destroy(result);
+		return NULL;
 	}
+	result->page_url = strdup(cda_page_url);
+	result->job.player_id = get_player_id(result->job.video_id);
+	if(result->page_url == NULL || result->job.player_id == NULL) {
+		fprintf(stderr, "libcda_parse_create: could not allocate memory.\n");
+		libcda_parse_destroy(result);
+		return NULL;
+	}
+	result->settings.json_parser = LIBCDA_JSON_PARSER_LAZY;
+	result->engine.session = &(result->settings);
+	result->job.session = &(result->settings);
+	result->job.status = LIBCDA_STATUS_OK;
+	return result;
+}
 
-	free(video_id);
+/* Takes the URLs of the pages accept_first_page queued */
+static int collect_missing_urls(struct libcda_parse * parse) {
+	struct libcda_engine * engine = &(parse->engine);
+	struct libcda_transfer * transfer = NULL;
+	parse->missing_urls = calloc(parse->job.draft.url_count ? parse->job.draft.url_count : 1, sizeof(char *));
+	while((transfer = engine->queue_head) != NULL) {
+		engine->queue_head = transfer->next;
+		if(parse->missing_urls != NULL) {
+			parse->missing_urls[transfer->url_index] = transfer->url;
+			transfer->url = NULL;
+		}
+		--parse->job.pending;
+		free_transfer(transfer);
+	}
+	engine->queue_tail = NULL;
+	if(parse->missing_urls != NULL) return 0;
+	fprintf(stderr, "libcda_parse_page: could not allocate memory.\n");
+	fail_job(&(parse->job), LIBCDA_STATUS_OUT_OF_MEMORY);
+	return 1;
+}
+
+/* Takes the first page, then the pages libcda_parse_missing_urls names,
+ * each with the URL it came from. A bad first page ends the parse, while
+ * a bad other page only gets its status back and can be tried again. */
+int libcda_parse_page(struct libcda_parse * parse, const char * page_url, const char * page, const size_t length) {
+	struct known_size_memory_region whole_page = {(char *)page, length};
+	struct libcda_transfer transfer;
+	size_t index = 0;
+	int result = LIBCDA_STATUS_OK;
+	if(parse->job.status != LIBCDA_STATUS_OK) return parse->job.status;
+	memset(&transfer, 0, sizeof(transfer));
+	transfer.job = &(parse->job);
+	transfer.page = &whole_page;
+	if(!parse->has_first_page) {
+		transfer.url = parse->page_url;
+		transfer.url_index = LIBCDA_FIRST_PAGE;
+		accept_first_page(&(parse->engine), &(parse->job), &transfer);
+		parse->has_first_page = 1;
+		collect_missing_urls(parse);
+		return parse->job.status;
+	}
+	while(index < parse->job.draft.url_count && (parse->missing_urls[index] == NULL || strcmp(parse->missing_urls[index], page_url))) ++index;
+	if(index == parse->job.draft.url_count) {
+		fprintf(stderr, "libcda_parse_page: %s is not a page this parse is missing.\n", page_url);
+		return LIBCDA_STATUS_BAD_PAGE_URL;
+	}
+	transfer.url = parse->missing_urls[index];
+	transfer.url_index = index;
+	accept_extra_page(&(parse->engine), &(parse->job), &transfer);
+	result = parse->job.status;
+	parse->job.status = LIBCDA_STATUS_OK;
+	if(result == LIBCDA_STATUS_OK) {
+		free(parse->missing_urls[index]);
+		parse->missing_urls[index] = NULL;
+	}
+	return result;
+}
+
+/* Puts up to capacity URLs of pages the parse still needs into page_urls
+ * and returns how many it needs in all. A URL stays valid until its page
+ * has been taken. */
+size_t libcda_parse_missing_urls(const struct libcda_parse * parse, const char ** page_urls, const size_t capacity) {
+	size_t result = 0;
+	size_t counter = 0;
+	if(!parse->has_first_page) {
+		if(capacity) page_urls[0] = parse->page_url;
+		return 1;
+	}
+	for(counter = 0; parse->missing_urls != NULL && counter < parse->job.draft.url_count; ++counter) {
+		if(parse->missing_urls[counter] == NULL) continue;
+		if(result < capacity) page_urls[result] = parse->missing_urls[counter];
+		++result;
+	}
+	return result;
+}
+
+/* What the parse knows so far. While pages are missing, their URLs are
+ * NULL and the status is LIBCDA_STATUS_PARTIAL. It is the caller's to free
+ * with libcda_free_get_url. */
+struct cda_results * libcda_parse_results(const struct libcda_parse * parse, int * status) {
+	struct cda_results * result = NULL;
+	int own_status = parse->job.status;
+	if(own_status == LIBCDA_STATUS_OK && !parse->has_first_page) own_status = LIBCDA_STATUS_PARSING_FAILED;
+	if(own_status == LIBCDA_STATUS_OK) {
+		result = pack_results_draft(&(parse->job.draft), 1);
+		if(result == NULL) own_status = LIBCDA_STATUS_OUT_OF_MEMORY;
+		else if(libcda_parse_missing_urls(parse, NULL, 0)) own_status = LIBCDA_STATUS_PARTIAL;
+	}
+	if(status != NULL) *status = own_status;
 	return result;
 }
@@ -0,0 +1,154 @@
+// SPDX-License-Identifier: LicenseRef-Dual-LGPLv3-OR-CC-BY-ND-For-Rust
+/* What get_url.c shares with bench/ and tests/, which link against
+ * src/get_url.o. None of it is exported from libcda.so. */
+#ifndef LIBCDA_GET_URL_INTERNAL_H
+#define LIBCDA_GET_URL_INTERNAL_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <curl/curl.h>
+
+#define LIBCDA_INTERNAL __attribute__((visibility("hidden")))
+
+struct cda_results;
+struct json_object;
+struct libcda_session;
+struct libcda_stats;
+
+struct known_size_memory_region {
+	char * memory;
+	size_t size;
+};
+
+/* A disk cache file, as get_url.c describes it. A slot that is being
+ * written to has an odd sequence with the pid of its writer in the upper
+ * half, and started_for tells which claim write_started was noted for. */
+#define DISK_CACHE_MAGIC	"libcda\x02\x00"
+#define DISK_CACHE_SLOT_SIZE	2048
+#define DISK_CACHE_PROBE	8
+#define DISK_CACHE_RETRIES	16
+#define DISK_CACHE_STALE_WRITE	10000
+#define DISK_CACHE_WRITER(sequence) ((pid_t)((sequence) >> 32))
+
+struct disk_cache_header {
+	char magic[8];
+	uint32_t slot_size;
+	uint32_t slot_count;
+	char padding[48];
+};
+
+struct disk_cache_slot {
+	uint64_t sequence;
+	int64_t write_started;
+	uint32_t started_for;
+	uint32_t key_length;
+	uint32_t payload_length;
+	uint32_t json_type;
+	uint64_t hash;
+	int64_t expiry;
+	char bytes[DISK_CACHE_SLOT_SIZE - 48];
+};
+
+struct libcda_disk_cache {
+	struct disk_cache_header * header;
+	struct disk_cache_slot * slots;
+	size_t mapping_size;
+	size_t slot_count;
+	int64_t ttl;
+};
+
+/* What a job has found out before its results get packed. The strings go
+ * back to back into one growing buffer and are found through their offsets,
+ * as the buffer moves whenever it grows. */
+#define RESULTS_DRAFT_NO_STRING ((size_t)-1)
+
+struct results_draft {
+	char * strings;
+	size_t strings_size;
+	size_t strings_capacity;
+	size_t * quality;
+	size_t * url;
+	size_t quality_count;
+	size_t url_count;
+	char json_type;
+};
+
+#define PLAYER_SCANNER_LOOKING	0
+#define PLAYER_SCANNER_IN_TAG	1
+#define PLAYER_SCANNER_DONE	2
+
+/* Follows a page while it downloads, looking for the start tag of
+ * div#mediaplayer<video_id>, which carries the player_data attribute.
+ * Every call only looks at bytes that arrived since the previous one, so
+ * the tag may be split across any number of chunks. */
+struct player_data_scanner {
+	const char * needle;
+	size_t needle_length;
+	size_t search_from;
+	size_t tag_position;
+	size_t element_start;
+	size_t element_end;
+	char quote;
+	char state;
+};
+
+/* A string inside player_data. It points either into the raw JSON, in
+ * which case escape sequences may still be in it, or into a json-c tree. */
+struct json_slice {
+	const char * start;
+	size_t length;
+	char escaped;
+};
+
+/* The fields of the video dictionary of player_data that libcda uses */
+struct player_data {
+	char * raw_json;
+	size_t raw_json_length;
+	struct json_object * big_json;
+	struct json_slice file;
+	struct json_slice manifest_apple;
+	struct json_slice quality;
+	struct json_slice * qualities;
+	size_t qualities_count;
+	char has_video;
+	char has_qualities;
+};
+
+/* Every kernel works in place on a buffer that is LIBCDA_SIMD_ALIGNMENT
+ * aligned and padded to a multiple of it, so the widest one may touch bytes
+ * past length without leaving the allocation. */
+#define LIBCDA_SIMD_ALIGNMENT 64
+
+struct libcda_kernels {
+	const char * name;
+	const char * cpu_feature;
+	void (*weird_decoding_ritual)(char *, const size_t);
+	uint64_t (*url_candidates)(const char *, const size_t);
+	size_t (*unquote)(char *, const char *, const size_t, size_t *);
+};
+
+LIBCDA_INTERNAL extern const struct libcda_kernels kernel_table[];
+LIBCDA_INTERNAL extern const size_t kernel_table_size;
+
+LIBCDA_INTERNAL CURL * acquire_curl_handle(struct libcda_session * session, const char * cda_url, curl_write_callback write_callback, void * write_data);
+LIBCDA_INTERNAL void release_curl_handle(struct libcda_session * session, CURL * curl);
+LIBCDA_INTERNAL struct cda_results * look_up_disk_results(struct libcda_disk_cache * cache, const char * video_id, const char * quality);
+LIBCDA_INTERNAL void store_disk_results(struct libcda_disk_cache * cache, const char * video_id, const char * quality, const struct cda_results * results);
+LIBCDA_INTERNAL void free_results_draft(struct results_draft * draft);
+LIBCDA_INTERNAL int scan_for_player_data(struct player_data_scanner * scanner, const struct known_size_memory_region * page);
+LIBCDA_INTERNAL char * get_player_id(const char * video_id);
+LIBCDA_INTERNAL char * extract_raw_json_with_libxml2(const char * video_id, const char * html_page, const size_t html_page_length);
+LIBCDA_INTERNAL char * decode_html_entities(const char * value, const size_t length);
+LIBCDA_INTERNAL char * extract_raw_json_fast(const char * html_page, const struct player_data_scanner * scanner);
+LIBCDA_INTERNAL void free_player_data(struct player_data * i);
+LIBCDA_INTERNAL char * json_slice_dup(const struct json_slice * slice);
+LIBCDA_INTERNAL int read_player_data_with_json_c(struct player_data * i);
+LIBCDA_INTERNAL int read_player_data_lazily(struct player_data * i);
+LIBCDA_INTERNAL int parse_player_data(struct player_data * result, const char * video_id, struct known_size_memory_region * html_page, const struct player_data_scanner * scanner, const int json_parser, struct libcda_stats * stats);
+LIBCDA_INTERNAL int cpu_supports_kernel(const struct libcda_kernels * candidate);
+LIBCDA_INTERNAL char * decode_url_in_stages(const char * encoded_url, const size_t length);
+LIBCDA_INTERNAL size_t decode_url(const char * encoded_url, const size_t length, struct results_draft * draft);
+LIBCDA_INTERNAL size_t get_url_from_json(const struct player_data * video, struct results_draft * draft);
+
+#endif
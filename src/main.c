@@ -1,9 +1,19 @@
 // SPDX-License-Identifier: LicenseRef-Dual-LGPLv3-OR-CC-BY-ND-For-Rust
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include <unistd.h>
-#include <curl/curl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
 
 /* Compile with:
  * gcc -ljson-c -lcurl $(xml2-config --libs) $(xml2-config --cflags) -O2 -Wall -Wextra -pedantic cda2url-unoptimized.c -o cda2url
@@ -11,20 +21,775 @@
 
 #include "libcda.h"
 
+/* Slots a new cache file gets, 8 MiB worth */
+#define CACHE_FILE_SLOTS 4096
+/* Resolves a bulk run keeps in flight unless -w says otherwise */
+#define BULK_WORKERS 8
+/* Results the daemon keeps in memory */
+#define DAEMON_CACHE_ENTRIES 4096
+/* Longest request line the daemon takes */
+#define DAEMON_LINE_MAX 8192
+
 void print_usage(const char * program_name) {
 	fprintf(stderr, "Usage: %s -u <video_url>\n", program_name);
 	fputs("Also -j gives JSON ouput\n", stderr);
+	fputs("Also -c <file> keeps results in a cache file for -t <seconds>, 3600 by default\n", stderr);
+	fputs("Also -s prints where the time went to stderr\n", stderr);
+	fputs("Also -2 asks for HTTP/2 and -z for compressed pages\n", stderr);
+	fputs("Also -q <quality> or -q best resolves just that quality, -m <quality> the best one up to it\n", stderr);
+	fputs("Or -b <file> resolves a URL per line of the file, - for stdin, printing a JSON object per line\n", stderr);
+	fputs("\twith -w <workers> at once, 8 by default, in input order or with -o as they finish;\n", stderr);
+	fputs("\ta summary goes to stderr\n", stderr);
+	fputs("Or -d <directory> does the same offline for saved pages, <id>.html and <id>_<quality>.html,\n", stderr);
+	fputs("\twith -w <threads>, all cores by default\n", stderr);
+	fputs("Or -S <socket> serves requests on a Unix socket until stopped, with -w resolves at once\n", stderr);
+	fputs("\tand -c as above; a request is a URL per line, answered by a line of JSON as -j prints\n", stderr);
+	fputs("\tor {\"status\":<status>} on failure\n", stderr);
+	fputs("Or -C <socket> asks a server for -u <video_url> or the URLs of -b <file>\n", stderr);
 }
 
-int main(int argc, char *argv[]) {
+void print_stats(const struct libcda_stats * stats) {
+	fprintf(stderr, "fetches: %zu (%zu for qualities), %zu bytes for %zu decoded, %zu saved\n", stats->fetches, stats->quality_fetches, stats->bytes_downloaded, stats->bytes_decoded,
+		stats->bytes_decoded > stats->bytes_downloaded ? stats->bytes_decoded - stats->bytes_downloaded : 0);
+	fprintf(stderr, "network: dns %.3f ms, connect %.3f ms, tls %.3f ms, first byte %.3f ms, total %.3f ms, slowest %.3f ms\n",
+		stats->dns_time / 1e6, stats->connect_time / 1e6, stats->tls_time / 1e6, stats->first_byte_time / 1e6, stats->fetch_time / 1e6, stats->slowest_fetch_time / 1e6);
+	fprintf(stderr, "parsing: html %.3f ms, json %.3f ms, decode %.3f ms\n", stats->html_time / 1e6, stats->json_time / 1e6, stats->decode_time / 1e6);
+	fprintf(stderr, "resolve: %.3f ms\n", stats->resolve_time / 1e6);
+}
+
+void print_result(struct cda_results * result, const int json_output) {
+	size_t counter = 0;
+	if(json_output) {
+		libcda_get_url2json(result);
+	} else {
+		switch(result->json_type) {
+			case LIBCDA_VIDEO_IS_FILE:
+				for(counter = 0; counter < result->url_count; ++counter) {
+					if (result->url[counter] != NULL) {
+						printf("Retrieved %s at %s\n", result->quality[counter], result->url[counter]);
+					}
+				}
+				break;
+
+			case LIBCDA_VIDEO_IS_M3U8:
+				printf("Retrieved stream at %s\n", result->url[0]);
+				for(counter = 0; counter < result->quality_count; ++counter) {
+					printf("Stream available in: %s\n", result->quality[counter]);
+				}
+				break;
+		}
+	}
+}
+
+/* Bulk mode. Every URL is a job of one async engine driven by poll(), with
+ * at most workers of them in flight. Lines are printed as soon as the order
+ * asked for allows it. */
+struct bulk_entry {
+	struct bulk_run * run;
+	char * url;
+	struct cda_results * result;
+	int status;
+	int finished;
+};
+
+struct bulk_run {
+	struct bulk_entry * entries;
+	size_t count;
+	size_t started;
+	size_t finished;
+	size_t printed;
+	size_t failures;
+	int completion_order;
+};
+
+static int read_urls(const char * path, struct bulk_run * run) {
+	FILE * file = strcmp(path, "-") ? fopen(path, "r") : stdin;
+	struct bulk_entry * bigger = NULL;
+	char * line = NULL;
+	size_t line_capacity = 0;
+	size_t capacity = 0;
+	ssize_t length = 0;
+	if(file == NULL) {
+		fprintf(stderr, "read_urls: could not open %s.\n", path);
+		return 1;
+	}
+	while((length = getline(&line, &line_capacity, file)) >= 0) {
+		while(length > 0 && (line[length - 1] == '\n' || line[length - 1] == '\r' || line[length - 1] == ' ' || line[length - 1] == '\t')) line[--length] = '\0';
+		if(!length) continue;
+		if(run->count == capacity) {
+			capacity = capacity ? capacity << 1 : 64;
+			bigger = realloc(run->entries, capacity * sizeof(struct bulk_entry));
+			if(bigger == NULL) break;
+			run->entries = bigger;
+		}
+		memset(run->entries + run->count, 0, sizeof(struct bulk_entry));
+		run->entries[run->count].run = run;
+		run->entries[run->count].url = strdup(line);
+		if(run->entries[run->count].url == NULL) break;
+		++(run->count);
+	}
+	free(line);
+	if(file != stdin) fclose(file);
+	if(length >= 0) {
+		fprintf(stderr, "read_urls: could not allocate memory for the URLs.\n");
+		return 1;
+	}
+	return 0;
+}
+
+static void print_json_string(const char * string) {
+	putchar('"');
+	for(; *string; ++string) {
+		if(*string == '"' || *string == '\\') printf("\\%c", *string);
+		else if((unsigned char)*string < 0x20) printf("\\u%04x", (unsigned char)*string);
+		else putchar(*string);
+	}
+	putchar('"');
+}
+
+static void print_json_strings(char ** strings, const size_t count) {
+	size_t counter = 0;
+	putchar('[');
+	for(counter = 0; counter < count; ++counter) {
+		if(counter) putchar(',');
+		if(strings[counter] != NULL) print_json_string(strings[counter]);
+		else fputs("null", stdout);
+	}
+	putchar(']');
+}
+
+static void print_bulk_entry(struct bulk_entry * entry) {
+	static const char * known_json_types[3] = {"none", "file", "m3u8"};
+	fputs("{\"page_url\":", stdout);
+	print_json_string(entry->url);
+	printf(",\"status\":%d", entry->status);
+	if(entry->result != NULL) {
+		printf(",\"json_type\":\"%s\",\"qualities\":", known_json_types[(size_t)(entry->result->json_type)]);
+		print_json_strings(entry->result->quality, entry->result->quality_count);
+		fputs(",\"urls\":", stdout);
+		print_json_strings(entry->result->url, entry->result->url_count);
+	}
+	puts("}");
+	libcda_free_get_url(entry->result);
+	entry->result = NULL;
+	free(entry->url);
+	entry->url = NULL;
+}
+
+static void finish_bulk_entry(struct bulk_entry * entry, struct cda_results * result, const int status) {
+	struct bulk_run * run = entry->run;
+	entry->result = result;
+	entry->status = status != LIBCDA_STATUS_OK ? status : result != NULL ? LIBCDA_STATUS_OK : LIBCDA_STATUS_DOWNLOAD_FAILED;
+	entry->finished = 1;
+	++(run->finished);
+	run->failures += entry->status != LIBCDA_STATUS_OK;
+	if(run->completion_order) {
+		print_bulk_entry(entry);
+		++(run->printed);
+	} else {
+		while(run->printed < run->count && run->entries[run->printed].finished) print_bulk_entry(run->entries + run->printed++);
+	}
+}
+
+static void bulk_result(struct cda_results * result, const int status, const struct libcda_stats * stats, void * userdata) {
+	(void)stats;
+	finish_bulk_entry(userdata, result, status);
+}
+
+/* The sockets libcda asks an async engine's caller to watch */
+struct watched_sockets {
+	struct pollfd * fds;
+	size_t count;
+	size_t capacity;
+	long timeout;
+};
+
+static void watch_socket(const int fd, const int events, void * userdata) {
+	struct watched_sockets * watched = userdata;
+	struct pollfd * bigger = NULL;
+	size_t counter = 0;
+	for(counter = 0; counter < watched->count && watched->fds[counter].fd != fd; ++counter);
+	if(events == LIBCDA_POLL_REMOVE) {
+		if(counter < watched->count) watched->fds[counter] = watched->fds[--(watched->count)];
+		return;
+	}
+	if(counter == watched->count) {
+		if(watched->count == watched->capacity) {
+			bigger = realloc(watched->fds, (watched->capacity + 16) * sizeof(struct pollfd));
+			if(bigger == NULL) {
+				fprintf(stderr, "watch_socket: could not allocate memory to watch a socket.\n");
+				return;
+			}
+			watched->fds = bigger;
+			watched->capacity += 16;
+		}
+		watched->fds[watched->count++].fd = fd;
+	}
+	watched->fds[counter].events = (events & LIBCDA_POLL_IN ? POLLIN : 0) | (events & LIBCDA_POLL_OUT ? POLLOUT : 0);
+}
+
+static void set_timer(const long timeout, void * userdata) {
+	((struct watched_sockets *)userdata)->timeout = timeout;
+}
+
+/* Polls the first own_count sockets of *polled, which the caller filled in,
+ * together with a copy of the watched ones after them, and performs on
+ * those of the copy that are ready or on the timeout. The copy is what
+ * keeps performing safe when libcda watches or drops sockets meanwhile.
+ * Returns what poll() did. */
+static int poll_with_async(struct libcda_async * async, struct watched_sockets * watched, struct pollfd ** polled, size_t * capacity, const size_t own_count) {
+	struct pollfd * bigger = NULL;
+	const size_t total = own_count + watched->count;
+	size_t counter = 0;
+	int ready = 0;
+	if(total > *capacity) {
+		bigger = realloc(*polled, total * sizeof(struct pollfd));
+		if(bigger == NULL) {
+			fprintf(stderr, "poll_with_async: could not allocate memory for sockets.\n");
+			return -1;
+		}
+		*polled = bigger;
+		*capacity = total;
+	}
+	if(watched->count) memcpy(*polled + own_count, watched->fds, watched->count * sizeof(struct pollfd));
+	ready = poll(*polled, total, watched->timeout < 0 ? 1000 : watched->timeout);
+	if(!ready) libcda_async_perform(async, LIBCDA_SOCKET_TIMEOUT, 0);
+	for(counter = own_count; ready > 0 && counter < total; ++counter) {
+		if((*polled)[counter].revents) libcda_async_perform(async, (*polled)[counter].fd, ((*polled)[counter].revents & (POLLIN | POLLHUP | POLLERR) ? LIBCDA_POLL_IN : 0) | ((*polled)[counter].revents & (POLLOUT | POLLERR) ? LIBCDA_POLL_OUT : 0));
+	}
+	return ready;
+}
+
+/* Jobs are only started out here, never from within a callback. An engine
+ * that breaks down fails every job, which ends the run too. */
+static int run_bulk(struct libcda_session * session, struct bulk_run * run, const size_t workers) {
+	struct watched_sockets watched = {NULL, 0, 0, -1};
+	struct libcda_async * async = libcda_async_create(session, workers, watch_socket, set_timer, &watched);
+	struct pollfd * polled = NULL;
+	size_t polled_capacity = 0;
+	if(async == NULL) return 1;
+	while(run->finished < run->count) {
+		while(run->started < run->count && run->started - run->finished < workers) {
+			if(libcda_async_get_url(async, run->entries[run->started].url, bulk_result, run->entries + run->started)) finish_bulk_entry(run->entries + run->started, NULL, LIBCDA_STATUS_OUT_OF_MEMORY);
+			++(run->started);
+		}
+		if(run->finished == run->count) break;
+		if(poll_with_async(async, &watched, &polled, &polled_capacity, 0) < 0 && errno != EINTR) break;
+	}
+	libcda_async_destroy(async);
+	free(polled);
+	free(watched.fds);
+	return run->finished < run->count;
+}
+
+static double seconds_since(const struct timespec * start) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+/* Offline mode. Threads take the videos of a directory of saved pages in
+ * turn and parse them straight from mapped files, with the pages of other
+ * qualities found by name. Lines are printed as in bulk mode. */
+struct offline_run {
+	struct bulk_run lines;
+	pthread_mutex_t lock;
+	const char * directory;
+	size_t next;
+	size_t pages;
+	size_t bytes;
+};
+
+static const char * map_page(const char * path, size_t * length) {
+	struct stat status;
+	void * page = MAP_FAILED;
+	const int fd = open(path, O_RDONLY);
+	if(fd < 0) return NULL;
+	if(!fstat(fd, &status) && status.st_size > 0) page = mmap(NULL, status.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if(page == MAP_FAILED) return NULL;
+	*length = status.st_size;
+	return page;
+}
+
+/* page_url is the URL of the first page, or one it asked for, which ends
+ * with ?wersja=<quality> */
+static int parse_saved_page(struct offline_run * run, struct libcda_parse * parse, const char * video_id, const char * page_url) {
+	const char * quality = strstr(page_url, "?wersja=");
+	const char * page = NULL;
+	char path[4096];
+	size_t length = 0;
+	int status = LIBCDA_STATUS_DOWNLOAD_FAILED;
+	if(quality != NULL) snprintf(path, sizeof(path), "%s/%s_%s.html", run->directory, video_id, quality + 8);
+	else snprintf(path, sizeof(path), "%s/%s.html", run->directory, video_id);
+	page = map_page(path, &length);
+	if(page == NULL) {
+		fprintf(stderr, "parse_saved_page: could not map %s.\n", path);
+		return status;
+	}
+	status = libcda_parse_page(parse, page_url, page, length);
+	munmap((void *)page, length);
+	pthread_mutex_lock(&(run->lock));
+	++(run->pages);
+	run->bytes += length;
+	pthread_mutex_unlock(&(run->lock));
+	return status;
+}
+
+static void parse_saved_video(struct offline_run * run, struct bulk_entry * entry) {
+	struct libcda_parse * parse = libcda_parse_create(entry->url);
 	struct cda_results * result = NULL;
+	const char ** missing_urls = NULL;
+	const char * video_id = strrchr(entry->url, '/') + 1;
+	size_t missing_count = 0;
 	size_t counter = 0;
+	int status = LIBCDA_STATUS_BAD_PAGE_URL;
+	if(parse != NULL) status = parse_saved_page(run, parse, video_id, entry->url);
+	if(status == LIBCDA_STATUS_OK) {
+		missing_count = libcda_parse_missing_urls(parse, NULL, 0);
+		missing_urls = missing_count ? malloc(missing_count * sizeof(char *)) : NULL;
+		if(missing_urls != NULL) libcda_parse_missing_urls(parse, missing_urls, missing_count);
+		for(counter = 0; missing_urls != NULL && counter < missing_count; ++counter) parse_saved_page(run, parse, video_id, missing_urls[counter]);
+		free(missing_urls);
+		result = libcda_parse_results(parse, &status);
+	}
+	libcda_parse_destroy(parse);
+	pthread_mutex_lock(&(run->lock));
+	finish_bulk_entry(entry, result, status);
+	pthread_mutex_unlock(&(run->lock));
+}
+
+static void * parse_saved_videos(void * argument) {
+	struct offline_run * run = argument;
+	size_t index = 0;
+	for(;;) {
+		pthread_mutex_lock(&(run->lock));
+		index = run->next++;
+		pthread_mutex_unlock(&(run->lock));
+		if(index >= run->lines.count) break;
+		parse_saved_video(run, run->lines.entries + index);
+	}
+	return NULL;
+}
+
+/* A video is named by its first page, a file without _ in its name */
+static int is_first_page(const struct dirent * entry) {
+	const size_t length = strlen(entry->d_name);
+	return length > 5 && !strcmp(entry->d_name + length - 5, ".html") && strchr(entry->d_name, '_') == NULL;
+}
+
+static int list_saved_videos(const char * directory, struct bulk_run * lines) {
+	struct dirent ** names = NULL;
+	static const char prefix[26] = "https://www.cda.pl/video/";
+	int name_count = scandir(directory, &names, is_first_page, alphasort);
+	int counter = 0;
+	size_t length = 0;
+	if(name_count < 0) {
+		fprintf(stderr, "list_saved_videos: could not read %s.\n", directory);
+		return 1;
+	}
+	lines->entries = calloc(name_count ? name_count : 1, sizeof(struct bulk_entry));
+	for(counter = 0; counter < name_count; ++counter) {
+		if(lines->entries != NULL) {
+			lines->entries[counter].run = lines;
+			length = strlen(names[counter]->d_name) - 5;
+			lines->entries[counter].url = malloc(sizeof(prefix) + length);
+			if(lines->entries[counter].url != NULL) {
+				memcpy(lines->entries[counter].url, prefix, sizeof(prefix) - 1);
+				memcpy(lines->entries[counter].url + sizeof(prefix) - 1, names[counter]->d_name, length);
+				lines->entries[counter].url[sizeof(prefix) - 1 + length] = '\0';
+				++(lines->count);
+			}
+		}
+		free(names[counter]);
+	}
+	free(names);
+	if(lines->entries != NULL && lines->count == (size_t)name_count) return 0;
+	fprintf(stderr, "list_saved_videos: could not allocate memory for the videos.\n");
+	return 1;
+}
+
+static int parse_offline(const char * directory, size_t threads, const int completion_order) {
+	struct offline_run run = {0};
+	pthread_t * workers = NULL;
+	struct timespec start;
+	double elapsed = 0;
+	size_t started = 0;
+	size_t counter = 0;
+
+	if(!threads) threads = sysconf(_SC_NPROCESSORS_ONLN) > 0 ? sysconf(_SC_NPROCESSORS_ONLN) : 1;
+	run.directory = directory;
+	run.lines.completion_order = completion_order;
+	pthread_mutex_init(&(run.lock), NULL);
+	if(!list_saved_videos(directory, &(run.lines)) && !libcda_global_init()) {
+		workers = calloc(threads, sizeof(pthread_t));
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		for(started = 0; workers != NULL && started < threads; ++started) {
+			if(pthread_create(workers + started, NULL, parse_saved_videos, &run)) break;
+		}
+		if(!started) parse_saved_videos(&run);
+		for(counter = 0; counter < started; ++counter) pthread_join(workers[counter], NULL);
+		elapsed = seconds_since(&start);
+		free(workers);
+		libcda_global_cleanup();
+		fflush(stdout);
+		fprintf(stderr, "offline: %zu videos, %zu failed, %zu pages, %zu threads, %.3f s, %.1f pages/s, %.1f MiB/s\n",
+			run.lines.count, run.lines.failures, run.pages, started ? started : 1, elapsed, elapsed > 0 ? run.pages / elapsed : 0, elapsed > 0 ? run.bytes / elapsed / 1048576 : 0);
+	}
+	for(counter = 0; counter < run.lines.count; ++counter) {
+		libcda_free_get_url(run.lines.entries[counter].result);
+		free(run.lines.entries[counter].url);
+	}
+	free(run.lines.entries);
+	pthread_mutex_destroy(&(run.lock));
+	return run.lines.finished < run.lines.count || run.lines.failures;
+}
+
+/* Applies what the command line says about caches and transfers */
+static void set_session_options(struct libcda_session * session, struct libcda_disk_cache * cache, const int http2, const int compression) {
+	if(cache != NULL) libcda_session_setopt(session, LIBCDA_OPT_DISK_CACHE, cache);
+	libcda_session_setopt(session, LIBCDA_OPT_HTTP2, (long)http2);
+	libcda_session_setopt(session, LIBCDA_OPT_COMPRESSION, (long)compression);
+}
+
+static int resolve_in_bulk(const char * path, const size_t workers, const int completion_order, struct libcda_disk_cache * cache, const int http2, const int compression, const int show_stats) {
+	struct bulk_run run = {0};
+	struct libcda_session * session = NULL;
+	struct libcda_stats stats = {0};
+	struct timespec start;
+	double elapsed = 0;
+	size_t counter = 0;
+	int broke_down = 0;
+
+	run.completion_order = completion_order;
+	if(read_urls(path, &run) || libcda_global_init()) {
+		for(counter = 0; counter < run.count; ++counter) free(run.entries[counter].url);
+		free(run.entries);
+		return 1;
+	}
+	session = libcda_session_create();
+	if(session == NULL) {
+		fprintf(stderr, "resolve_in_bulk: could not create session.\n");
+	} else {
+		set_session_options(session, cache, http2, compression);
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		broke_down = run_bulk(session, &run, workers);
+		elapsed = seconds_since(&start);
+		libcda_session_get_stats(session, &stats);
+		libcda_session_destroy(session);
+	}
+	libcda_global_cleanup();
+	fflush(stdout);
+
+	for(counter = 0; counter < run.count; ++counter) {
+		libcda_free_get_url(run.entries[counter].result);
+		free(run.entries[counter].url);
+	}
+	free(run.entries);
+	if(session == NULL) return 1;
+	if(broke_down) fprintf(stderr, "resolve_in_bulk: gave up with %zu of %zu URLs unresolved.\n", run.count - run.finished, run.count);
+	fprintf(stderr, "bulk: %zu URLs, %zu failed, %zu workers, %.3f s, %.1f URLs/s\n", run.count, run.failures + run.count - run.finished, workers, elapsed, elapsed > 0 ? run.finished / elapsed : 0);
+	if(show_stats) print_stats(&stats);
+	return broke_down || run.failures;
+}
+
+/* Daemon mode. One thread polls the listening socket, its clients and the
+ * sockets of a single async engine, so connections and caches stay warm
+ * from one request to the next. A client has one request in flight at a
+ * time and gets its answers in order; clients that want more at once open
+ * more connections. */
+struct daemon_client {
+	int fd;
+	char input[DAEMON_LINE_MAX];
+	size_t input_length;
+	char * output;
+	size_t output_length;
+	size_t output_sent;
+	int busy;
+	int hung_up;
+	int broken;
+};
+
+static volatile sig_atomic_t daemon_stopping = 0;
+
+static void stop_daemon(const int signal_number) {
+	(void)signal_number;
+	daemon_stopping = 1;
+}
+
+static void answer_client(struct daemon_client * client, const char * answer) {
+	const size_t length = strlen(answer);
+	char * bigger = NULL;
+	client->busy = 0;
+	if(client->broken) return;
+	bigger = realloc(client->output, client->output_length + length + 1);
+	if(bigger == NULL) {
+		fprintf(stderr, "answer_client: could not allocate memory for an answer.\n");
+		client->broken = 1;
+		return;
+	}
+	client->output = bigger;
+	memcpy(client->output + client->output_length, answer, length);
+	client->output[client->output_length + length] = '\n';
+	client->output_length += length + 1;
+}
+
+static void daemon_result(struct cda_results * result, const int status, const struct libcda_stats * stats, void * userdata) {
+	char * json = result != NULL ? libcda_results_json(result) : NULL;
+	char failure[32];
+	(void)stats;
+	snprintf(failure, sizeof(failure), "{\"status\":%d}", result != NULL ? LIBCDA_STATUS_OUT_OF_MEMORY : status != LIBCDA_STATUS_OK ? status : LIBCDA_STATUS_DOWNLOAD_FAILED);
+	answer_client(userdata, json != NULL ? json : failure);
+	free(json);
+	libcda_free_get_url(result);
+}
+
+/* Starts the next request a client has sent in full, if it is not busy */
+static void serve_client(struct libcda_async * async, struct daemon_client * client) {
+	char * end = NULL;
+	size_t line_length = 0;
+	while(!client->busy && !client->broken && (end = memchr(client->input, '\n', client->input_length)) != NULL) {
+		*end = '\0';
+		line_length = end - client->input;
+		if(line_length && client->input[line_length - 1] == '\r') client->input[line_length - 1] = '\0';
+		if(client->input[0] != '\0') {
+			client->busy = 1;
+			if(libcda_async_get_url(async, client->input, daemon_result, client)) answer_client(client, "{\"status\":5}");
+		}
+		client->input_length -= line_length + 1;
+		memmove(client->input, end + 1, client->input_length);
+	}
+	if(!client->busy && client->input_length == sizeof(client->input)) {
+		fprintf(stderr, "serve_client: a request is longer than %d bytes.\n", DAEMON_LINE_MAX);
+		client->broken = 1;
+	}
+}
+
+static void read_client(struct daemon_client * client) {
+	const ssize_t received = recv(client->fd, client->input + client->input_length, sizeof(client->input) - client->input_length, 0);
+	if(received > 0) client->input_length += received;
+	else if(!received) client->hung_up = 1;
+	else if(errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) client->broken = 1;
+}
+
+static void write_client(struct daemon_client * client) {
+	const ssize_t sent = send(client->fd, client->output + client->output_sent, client->output_length - client->output_sent, MSG_NOSIGNAL);
+	if(sent > 0) client->output_sent += sent;
+	else if(errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) client->broken = 1;
+	if(client->output_sent == client->output_length) client->output_length = client->output_sent = 0;
+}
+
+/* A client that is gone is only let go of once its resolve has called back */
+static int client_is_done(const struct daemon_client * client) {
+	if(client->busy) return 0;
+	return client->broken || (client->hung_up && !client->output_length && memchr(client->input, '\n', client->input_length) == NULL);
+}
+
+static int listen_on(const char * path) {
+	struct sockaddr_un address = {0};
+	const int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+	int probe = -1;
+	if(listener < 0 || strlen(path) >= sizeof(address.sun_path)) {
+		fprintf(stderr, "listen_on: could not make a socket at %s.\n", path);
+		if(listener >= 0) close(listener);
+		return -1;
+	}
+	address.sun_family = AF_UNIX;
+	strcpy(address.sun_path, path);
+/* A socket file nobody answers on is left over from a server that died */
+	if(bind(listener, (struct sockaddr *)&address, sizeof(address)) && errno == EADDRINUSE) {
+		probe = socket(AF_UNIX, SOCK_STREAM, 0);
+		if(probe >= 0 && connect(probe, (struct sockaddr *)&address, sizeof(address)) && errno == ECONNREFUSED) unlink(path);
+		if(probe >= 0) close(probe);
+		bind(listener, (struct sockaddr *)&address, sizeof(address));
+	}
+	if(listen(listener, 128) || fcntl(listener, F_SETFL, O_NONBLOCK)) {
+		fprintf(stderr, "listen_on: could not listen on %s: %s\n", path, strerror(errno));
+		close(listener);
+		return -1;
+	}
+	return listener;
+}
+
+static void accept_clients(const int listener, struct daemon_client *** clients, size_t * client_count) {
+	struct daemon_client ** bigger = NULL;
+	struct daemon_client * client = NULL;
+	int fd = -1;
+	while((fd = accept(listener, NULL, NULL)) >= 0) {
+		client = calloc(1, sizeof(struct daemon_client));
+		bigger = client != NULL ? realloc(*clients, (*client_count + 1) * sizeof(struct daemon_client *)) : NULL;
+		if(bigger == NULL || fcntl(fd, F_SETFL, O_NONBLOCK)) {
+			fprintf(stderr, "accept_clients: could not take a client.\n");
+			free(client);
+			close(fd);
+			continue;
+		}
+		*clients = bigger;
+		client->fd = fd;
+		(*clients)[(*client_count)++] = client;
+	}
+}
+
+static void run_daemon(const int listener, struct libcda_session * session, const size_t workers) {
+	struct watched_sockets watched = {NULL, 0, 0, -1};
+	struct libcda_async * async = libcda_async_create(session, workers, watch_socket, set_timer, &watched);
+	struct daemon_client ** clients = NULL;
+	struct daemon_client * client = NULL;
+	struct pollfd * polled = NULL;
+	size_t polled_capacity = 0;
+	size_t client_count = 0;
+	size_t counter = 0;
+	int ready = 0;
+	if(async == NULL) return;
+	while(!daemon_stopping) {
+		if(polled_capacity < client_count + 1) {
+			free(polled);
+			polled_capacity = client_count + 1;
+			polled = malloc(polled_capacity * sizeof(struct pollfd));
+			if(polled == NULL) {
+				fprintf(stderr, "run_daemon: could not allocate memory for sockets.\n");
+				break;
+			}
+		}
+		polled[0].fd = listener;
+		polled[0].events = POLLIN;
+		for(counter = 0; counter < client_count; ++counter) {
+			client = clients[counter];
+			polled[counter + 1].fd = client->fd;
+			polled[counter + 1].events = (!client->busy && !client->hung_up && client->input_length < sizeof(client->input) ? POLLIN : 0) | (client->output_length ? POLLOUT : 0);
+		}
+		ready = poll_with_async(async, &watched, &polled, &polled_capacity, client_count + 1);
+		if(ready < 0 && errno != EINTR) break;
+		for(counter = 0; ready > 0 && counter < client_count; ++counter) {
+			client = clients[counter];
+			if(polled[counter + 1].revents & (POLLIN | POLLHUP | POLLERR)) read_client(client);
+			if(polled[counter + 1].revents & POLLOUT) write_client(client);
+		}
+		for(counter = 0; counter < client_count; ++counter) serve_client(async, clients[counter]);
+		for(counter = 0; counter < client_count;) {
+			if(!client_is_done(clients[counter])) {
+				++counter;
+				continue;
+			}
+			close(clients[counter]->fd);
+			free(clients[counter]->output);
+			free(clients[counter]);
+			clients[counter] = clients[--client_count];
+		}
+		if(ready > 0 && polled[0].revents & POLLIN) accept_clients(listener, &clients, &client_count);
+	}
+/* Resolves still running are cancelled, calling back into their clients */
+	libcda_async_destroy(async);
+	for(counter = 0; counter < client_count; ++counter) {
+		close(clients[counter]->fd);
+		free(clients[counter]->output);
+		free(clients[counter]);
+	}
+	free(clients);
+	free(polled);
+	free(watched.fds);
+}
+
+static int serve(const char * path, const size_t workers, const long cache_ttl, struct libcda_disk_cache * disk_cache, const int http2, const int compression, const int show_stats) {
+	struct libcda_session * session = NULL;
+	struct libcda_cache * cache = NULL;
+	struct libcda_stats stats = {0};
+	struct sigaction stopping;
+	int listener = -1;
+
+	memset(&stopping, 0, sizeof(stopping));
+	stopping.sa_handler = stop_daemon;
+	sigemptyset(&stopping.sa_mask);
+	sigaction(SIGINT, &stopping, NULL);
+	sigaction(SIGTERM, &stopping, NULL);
+	if(libcda_global_init()) return 1;
+	session = libcda_session_create();
+	cache = libcda_cache_create(DAEMON_CACHE_ENTRIES, cache_ttl * 1000);
+	if(session != NULL && cache != NULL) listener = listen_on(path);
+	if(listener >= 0) {
+		libcda_session_setopt(session, LIBCDA_OPT_CACHE, cache);
+		set_session_options(session, disk_cache, http2, compression);
+		run_daemon(listener, session, workers);
+		close(listener);
+		unlink(path);
+		libcda_session_get_stats(session, &stats);
+		if(show_stats) print_stats(&stats);
+	} else if(session == NULL || cache == NULL) {
+		fprintf(stderr, "serve: could not create session.\n");
+	}
+	libcda_session_destroy(session);
+	libcda_cache_destroy(cache);
+	libcda_global_cleanup();
+	return listener < 0;
+}
+
+/* Asks for one URL at a time and prints the answers as they come */
+static int ask_server(const char * path, const char * video_url, const char * url_file) {
+	struct sockaddr_un address = {0};
+	struct bulk_run urls = {0};
+	FILE * answers = NULL;
+	char * answer = NULL;
+	size_t answer_capacity = 0;
+	size_t counter = 0;
+	size_t failures = 0;
+	const char * url = NULL;
+	int fd = -1;
+
+	if(url_file != NULL && read_urls(url_file, &urls)) return 1;
+	address.sun_family = AF_UNIX;
+	if(strlen(path) < sizeof(address.sun_path)) {
+		strcpy(address.sun_path, path);
+		fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	}
+	if(fd >= 0 && connect(fd, (struct sockaddr *)&address, sizeof(address))) {
+		close(fd);
+		fd = -1;
+	}
+	answers = fd >= 0 ? fdopen(fd, "r") : NULL;
+	if(answers == NULL) {
+		fprintf(stderr, "ask_server: could not connect to %s.\n", path);
+		if(fd >= 0) close(fd);
+	}
+	for(counter = 0; answers != NULL && counter < (url_file != NULL ? urls.count : 1); ++counter) {
+		url = url_file != NULL ? urls.entries[counter].url : video_url;
+		if(send(fd, url, strlen(url), MSG_NOSIGNAL) < 0 || send(fd, "\n", 1, MSG_NOSIGNAL) < 0 || getline(&answer, &answer_capacity, answers) < 0) {
+			fprintf(stderr, "ask_server: the server went away.\n");
+			break;
+		}
+		failures += !strncmp(answer, "{\"status\":", 10);
+		fputs(answer, stdout);
+	}
+	for(counter = 0; counter < urls.count; ++counter) free(urls.entries[counter].url);
+	free(urls.entries);
+	free(answer);
+	if(answers != NULL) fclose(answers);
+	return answers == NULL || counter < (url_file != NULL ? urls.count : 1) || failures;
+}
+
+int main(int argc, char *argv[]) {
+	struct cda_results * result = NULL;
+	struct libcda_session * session = NULL;
+	struct libcda_disk_cache * cache = NULL;
+	struct libcda_stats stats = {0};
 	char * video_url = NULL;
+	char * cache_file = NULL;
+	char * bulk_file = NULL;
+	char * saved_pages = NULL;
+	char * served_socket = NULL;
+	char * server_socket = NULL;
+	size_t workers = 0;
+	int completion_order = 0;
+	int http2 = 0;
+	int compression = 0;
+	long cache_ttl = 3600;
 	int json_output = 0;
-	CURLcode http_engine;
+	int show_stats = 0;
+	int preference = LIBCDA_QUALITY_ALL;
+	char * quality = NULL;
+	char cache_key[64];
 
 	int opt;
-	while ((opt = getopt(argc, argv, "u:hj")) != -1) {
+	while ((opt = getopt(argc, argv, "u:c:t:q:m:b:d:w:S:C:ohjs2z")) != -1) {
 		switch (opt) {
 			case 'u':
 				video_url = optarg;
@@ -32,6 +797,47 @@ int main(int argc, char *argv[]) {
 			case 'j':
 				json_output = 1;
 				break;
+			case 's':
+				show_stats = 1;
+				break;
+			case 'q':
+				quality = optarg;
+				preference = strcmp(optarg, "best") ? LIBCDA_QUALITY_EXACT : LIBCDA_QUALITY_BEST;
+				break;
+			case 'm':
+				quality = optarg;
+				preference = LIBCDA_QUALITY_AT_MOST;
+				break;
+			case 'c':
+				cache_file = optarg;
+				break;
+			case 't':
+				cache_ttl = atol(optarg);
+				break;
+			case 'b':
+				bulk_file = optarg;
+				break;
+			case 'd':
+				saved_pages = optarg;
+				break;
+			case 'S':
+				served_socket = optarg;
+				break;
+			case 'C':
+				server_socket = optarg;
+				break;
+			case 'w':
+				workers = strtoul(optarg, NULL, 10);
+				break;
+			case 'o':
+				completion_order = 1;
+				break;
+			case '2':
+				http2 = 1;
+				break;
+			case 'z':
+				compression = 1;
+				break;
 			case 'h':
 			default:
 				print_usage(argv[0]);
@@ -39,42 +845,88 @@ int main(int argc, char *argv[]) {
 		}
 	}
 
+	if (served_socket != NULL) {
+		if (video_url != NULL || quality != NULL || bulk_file != NULL || saved_pages != NULL || server_socket != NULL) {
+			fprintf(stderr, "Error: -S takes no -u, -q, -m, -b, -d or -C.\n");
+			print_usage(argv[0]);
+			return 1;
+		}
+		if (cache_file != NULL) cache = libcda_disk_cache_open(cache_file, CACHE_FILE_SLOTS, cache_ttl * 1000);
+		opt = serve(served_socket, workers ? workers : BULK_WORKERS, cache_ttl, cache, http2, compression, show_stats);
+		libcda_disk_cache_close(cache);
+		return opt;
+	}
+
+	if (server_socket != NULL) {
+		if ((video_url == NULL) == (bulk_file == NULL) || quality != NULL || saved_pages != NULL || cache_file != NULL) {
+			fprintf(stderr, "Error: -C takes either -u or -b, and no -q, -m, -d or -c.\n");
+			print_usage(argv[0]);
+			return 1;
+		}
+		return ask_server(server_socket, video_url, bulk_file);
+	}
+
+	if (saved_pages != NULL) {
+		if (video_url != NULL || quality != NULL || bulk_file != NULL || cache_file != NULL) {
+			fprintf(stderr, "Error: -d takes no -u, -q, -m, -b or -c.\n");
+			print_usage(argv[0]);
+			return 1;
+		}
+		return parse_offline(saved_pages, workers, completion_order);
+	}
+
+	if (bulk_file != NULL) {
+		if (video_url != NULL || quality != NULL) {
+			fprintf(stderr, "Error: -b takes no -u, -q or -m.\n");
+			print_usage(argv[0]);
+			return 1;
+		}
+		if (cache_file != NULL) cache = libcda_disk_cache_open(cache_file, CACHE_FILE_SLOTS, cache_ttl * 1000);
+		opt = resolve_in_bulk(bulk_file, workers ? workers : BULK_WORKERS, completion_order, cache, http2, compression, show_stats);
+		libcda_disk_cache_close(cache);
+		return opt;
+	}
+
 	if (video_url == NULL) {
 		fprintf(stderr, "Error: No video URL specified.\n");
 		print_usage(argv[0]);
 		return 1;
 	}
 
-	http_engine = curl_global_init(CURL_GLOBAL_ALL);
-	if (http_engine) {
-		fprintf(stderr, "main: could not initialize HTTP engine.\n");
-		return 1;
+/* A cached result is printed before the HTTP engine is even started.
+ * Results for a quality preference are kept under the key libcda uses. */
+	if (cache_file != NULL) {
+		cache = libcda_disk_cache_open(cache_file, CACHE_FILE_SLOTS, cache_ttl * 1000);
+		snprintf(cache_key, sizeof(cache_key), "%s%s", preference == LIBCDA_QUALITY_AT_MOST ? "<=" : "", quality != NULL ? quality : "");
+		if (cache != NULL) result = libcda_disk_cache_lookup(cache, video_url, quality != NULL ? cache_key : NULL);
 	}
 
-	result = libcda_get_url(video_url);
-	curl_global_cleanup();
-
-	if (result != NULL) {
-		if(json_output) {
-			libcda_get_url2json(result);
-		} else {
-			switch(result->json_type) {
-				case LIBCDA_VIDEO_IS_FILE:
-					for(counter = 0; counter < result->url_count; ++counter) {
-						if (result->url[counter] != NULL) {
-							printf("Retrieved %s at %s\n", result->quality[counter], result->url[counter]);
-						}
-					}
-					break;
+	if (result == NULL) {
+		if (libcda_global_init()) {
+			libcda_disk_cache_close(cache);
+			return 1;
+		}
 
-				case LIBCDA_VIDEO_IS_M3U8:
-					printf("Retrieved stream at %s\n", result->url[0]);
-					for(counter = 0; counter < result->quality_count; ++counter) {
-						printf("Stream available in: %s\n", result->quality[counter]);
-					}
-					break;
-			}
+		session = libcda_session_create();
+		if (session == NULL) {
+			fprintf(stderr, "main: could not create session.\n");
+			libcda_disk_cache_close(cache);
+			libcda_global_cleanup();
+			return 1;
 		}
+		set_session_options(session, cache, http2, compression);
+
+		if (preference == LIBCDA_QUALITY_ALL) result = libcda_session_get_url(session, video_url);
+		else result = libcda_session_get_url_in_quality(session, video_url, preference, quality, NULL);
+		libcda_session_get_stats(session, &stats);
+		libcda_session_destroy(session);
+		libcda_global_cleanup();
+	}
+	libcda_disk_cache_close(cache);
+	if (show_stats) print_stats(&stats);
+
+	if (result != NULL) {
+		print_result(result, json_output);
 		libcda_free_get_url(result);
 		result = NULL;
 	} else {
@@ -1,13 +1,11 @@
 // SPDX-License-Identifier: LicenseRef-Dual-LGPLv3-OR-CC-BY-ND-For-Rust
 #include <mmintrin.h>
-#define ALIGNMENT 8
-#define ALIGNMENT_BITSHIFT 3
-#define ALIGNMENT_MASK 7
-#define LIBCDA_URL_DECODING_IS_OPTIMIZED
 
-static void weird_decoding_ritual(__m64 * inplace, const size_t length) {
+__attribute__((target("mmx")))
+static void weird_decoding_ritual_mmx(char * string, const size_t length) {
+	__m64 * inplace = (__m64 *)string;
 	size_t counter;
-	size_t vec_length = ((length + ALIGNMENT_MASK) & (~ALIGNMENT_MASK)) >> ALIGNMENT_BITSHIFT;
+	size_t vec_length = (length + sizeof(__m64) - 1) / sizeof(__m64);
 	__m64 forty_seven = _mm_set1_pi8(47);
 	__m64 seventy_nine = _mm_set1_pi8(79);
 	__m64 ninety_four = _mm_set1_pi8(94);
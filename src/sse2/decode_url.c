@@ -1,13 +1,11 @@
 // SPDX-License-Identifier: LicenseRef-Dual-LGPLv3-OR-CC-BY-ND-For-Rust
 #include <emmintrin.h>
-#define ALIGNMENT 16
-#define ALIGNMENT_BITSHIFT 4
-#define ALIGNMENT_MASK 15
-#define LIBCDA_URL_DECODING_IS_OPTIMIZED
 
-static void weird_decoding_ritual(__m128i * inplace, const size_t length) {
+__attribute__((target("sse2")))
+static void weird_decoding_ritual_sse2(char * string, const size_t length) {
+	__m128i * inplace = (__m128i *)string;
 	size_t counter;
-	size_t vec_length = ((length + ALIGNMENT_MASK) & (~ALIGNMENT_MASK)) >> ALIGNMENT_BITSHIFT;
+	size_t vec_length = (length + sizeof(__m128i) - 1) / sizeof(__m128i);
 	__m128i forty_seven = _mm_set1_epi8(47);
 	__m128i seventy_nine = _mm_set1_epi8(79);
 	__m128i ninety_four = _mm_set1_epi8(94);
@@ -22,3 +20,20 @@ static void weird_decoding_ritual(__m128i * inplace, const size_t length) {
 		_mm_store_si128(inplace + counter, data);
 	}
 }
+
+/* Bit n is set when string[n] is '_' or '%', which is where every token and
+ * escape in a file string begins. Looks at no more than 64 bytes. */
+__attribute__((target("sse2")))
+static uint64_t url_candidates_sse2(const char * string, const size_t length) {
+	__m128i underscore = _mm_set1_epi8('_');
+	__m128i percent = _mm_set1_epi8('%');
+	__m128i data;
+	uint64_t mask = 0;
+	size_t counter = 0;
+	for(; counter < 64 && counter + sizeof(__m128i) <= length; counter += sizeof(__m128i)) {
+		data = _mm_loadu_si128((const __m128i *)(string + counter));
+		mask |= (uint64_t)(unsigned int)_mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(data, underscore), _mm_cmpeq_epi8(data, percent))) << counter;
+	}
+	for(; counter < 64 && counter < length; ++counter) mask |= (uint64_t)(string[counter] == '_' || string[counter] == '%') << counter;
+	return mask;
+}
@@ -0,0 +1,79 @@
+// SPDX-License-Identifier: LicenseRef-Dual-LGPLv3-OR-CC-BY-ND-For-Rust
+#include <tmmintrin.h>
+
+/* pshufb controls that gather the bytes whose bits are set in an 8 bit mask to
+ * the front, e.g. 0x05 -> {0, 2, ...}. Shared with the AVX2 kernel. */
+static unsigned char unquote_shuffles[256][8];
+
+static void build_unquote_shuffles(void) {
+	size_t mask;
+	size_t bit;
+	size_t kept;
+	for(mask = 0; mask < 256; ++mask) {
+		for(bit = kept = 0; bit < 8; ++bit) if(mask & (1 << bit)) unquote_shuffles[mask][kept++] = bit;
+		for(; kept < 8; ++kept) unquote_shuffles[mask][kept] = 0x80;
+	}
+}
+
+/* The same arithmetic as unescape_url_byte on every lane: (c & 0xF) plus 9
+ * times c >> 6, where c >> 6 is -2, -1, 0 or 1 and has to be pieced together
+ * from signed compares as there is no 8 bit shift. */
+__attribute__((target("ssse3")))
+static __m128i unescape_url_bytes_ssse3(const __m128i high, const __m128i low) {
+	__m128i nibble = _mm_set1_epi8(0xF);
+	__m128i nine = _mm_set1_epi8(9);
+	__m128i minus_nine = _mm_set1_epi8(-9);
+	__m128i zero = _mm_setzero_si128();
+	__m128i h = _mm_and_si128(high, nibble);
+	__m128i l = _mm_and_si128(low, nibble);
+	h = _mm_add_epi8(h, _mm_and_si128(_mm_cmpgt_epi8(high, _mm_set1_epi8(63)), nine));
+	h = _mm_add_epi8(h, _mm_and_si128(_mm_cmpgt_epi8(zero, high), minus_nine));
+	h = _mm_add_epi8(h, _mm_and_si128(_mm_cmpgt_epi8(_mm_set1_epi8(-64), high), minus_nine));
+	l = _mm_add_epi8(l, _mm_and_si128(_mm_cmpgt_epi8(low, _mm_set1_epi8(63)), nine));
+	l = _mm_add_epi8(l, _mm_and_si128(_mm_cmpgt_epi8(zero, low), minus_nine));
+	l = _mm_add_epi8(l, _mm_and_si128(_mm_cmpgt_epi8(_mm_set1_epi8(-64), low), minus_nine));
+	return _mm_or_si128(_mm_and_si128(_mm_slli_epi16(h, 4), _mm_set1_epi8(-16)), l);
+}
+
+/* unquote_generic 16 bytes at a time. Each block is loaded whole, along with
+ * the two bytes after it, before anything is stored, and nothing is stored
+ * past the block, so output may be input. An escape in the last two lanes
+ * takes its digits from the next block, which then starts after them. */
+__attribute__((target("ssse3")))
+static size_t unquote_ssse3(char * output, const char * input, const size_t length, size_t * consumed) {
+	size_t read_counter = 0;
+	size_t write_counter = 0;
+	size_t tail_consumed;
+	__m128i percent = _mm_set1_epi8('%');
+	__m128i data;
+	__m128i escapes;
+	__m128i decoded;
+	unsigned int starts;
+	unsigned int digits;
+	unsigned int kept;
+	while(read_counter + sizeof(__m128i) + 2 <= length) {
+		data = _mm_loadu_si128((const __m128i *)(input + read_counter));
+		escapes = _mm_cmpeq_epi8(data, percent);
+		starts = _mm_movemask_epi8(escapes);
+		if(!starts) {
+			_mm_storeu_si128((__m128i *)(output + write_counter), data);
+			read_counter += sizeof(__m128i);
+			write_counter += sizeof(__m128i);
+			continue;
+		}
+		digits = (starts << 1) | (starts << 2);
+		/* A '%' that is another escape's digit; leave the rest to the scalar loop. */
+		if(starts & digits) break;
+		decoded = unescape_url_bytes_ssse3(_mm_loadu_si128((const __m128i *)(input + read_counter + 1)), _mm_loadu_si128((const __m128i *)(input + read_counter + 2)));
+		data = _mm_or_si128(_mm_and_si128(escapes, decoded), _mm_andnot_si128(escapes, data));
+		kept = ~digits & 0xFFFF;
+		_mm_storel_epi64((__m128i *)(output + write_counter), _mm_shuffle_epi8(data, _mm_loadl_epi64((const __m128i *)unquote_shuffles[kept & 0xFF])));
+		write_counter += __builtin_popcount(kept & 0xFF);
+		_mm_storel_epi64((__m128i *)(output + write_counter), _mm_shuffle_epi8(_mm_srli_si128(data, 8), _mm_loadl_epi64((const __m128i *)unquote_shuffles[kept >> 8])));
+		write_counter += __builtin_popcount(kept >> 8);
+		read_counter += sizeof(__m128i) + __builtin_popcount(digits >> 16);
+	}
+	write_counter += unquote_generic(output + write_counter, input + read_counter, length - read_counter, &tail_consumed);
+	*consumed = read_counter + tail_consumed;
+	return write_counter;
+}
@@ -0,0 +1,106 @@
+// SPDX-License-Identifier: LicenseRef-Dual-LGPLv3-OR-CC-BY-ND-For-Rust
+/* A disk cache slot left odd by a writer that went away, or that has been
+ * at it for too long, is claimed again by the next writer, while one whose
+ * writer is still on it is left alone. */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "libcda.h"
+#include "../src/get_url_internal.h"
+
+static char * qualities[] = {"720p"};
+
+static void store_url(struct libcda_disk_cache * cache, char * url) {
+	char * urls[] = {url};
+	struct cda_results results = {qualities, urls, 1, 1, LIBCDA_VIDEO_IS_FILE, NULL};
+	store_disk_results(cache, "abc123", NULL, &results);
+}
+
+/* NULL when there is no such result or it is being written */
+static char * look_up_url(struct libcda_disk_cache * cache) {
+	struct cda_results * result = look_up_disk_results(cache, "abc123", NULL);
+	char * url = result != NULL && result->url_count ? strdup(result->url[0]) : NULL;
+	libcda_free_get_url(result);
+	return url;
+}
+
+static struct disk_cache_slot * find_slot(struct libcda_disk_cache * cache) {
+	size_t counter = 0;
+	for(counter = 0; counter < cache->slot_count; ++counter) {
+		if(cache->slots[counter].key_length) return cache->slots + counter;
+	}
+	return NULL;
+}
+
+/* Leaves slot as if writer had claimed it at started, in milliseconds, and
+ * stopped right there */
+static void leave_odd(struct disk_cache_slot * slot, const pid_t writer, const int64_t started) {
+	const uint32_t claim = (uint32_t)(slot->sequence + 2) | 1;
+	slot->sequence = ((uint64_t)writer << 32) | claim;
+	slot->write_started = started;
+	slot->started_for = claim;
+}
+
+static pid_t dead_pid(void) {
+	const pid_t child = fork();
+	if(!child) _exit(0);
+	if(child > 0) waitpid(child, NULL, 0);
+	return child;
+}
+
+static int64_t now_milliseconds(void) {
+	struct timespec now;
+	clock_gettime(CLOCK_REALTIME, &now);
+	return (int64_t)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+static int check(const char * what, struct libcda_disk_cache * cache, const char * expected) {
+	char * url = look_up_url(cache);
+	const int failed = expected != NULL ? url == NULL || strcmp(url, expected) : url != NULL;
+	if(failed) fprintf(stderr, "disk_cache: %s: found %s, wanted %s.\n", what, url != NULL ? url : "nothing", expected != NULL ? expected : "nothing");
+	free(url);
+	return failed;
+}
+
+int main(void) {
+	char path[] = "/tmp/libcda-disk-cache-XXXXXX";
+	struct libcda_disk_cache * cache = NULL;
+	struct disk_cache_slot * slot = NULL;
+	int failures = 0;
+	int fd = mkstemp(path);
+	if(fd < 0) return 1;
+	close(fd);
+	cache = libcda_disk_cache_open(path, 64, 0);
+	unlink(path);
+	if(cache == NULL) return 1;
+
+	store_url(cache, "https://example.com/first.mp4");
+	failures += check("a plain store", cache, "https://example.com/first.mp4");
+	slot = find_slot(cache);
+	if(slot == NULL) {
+		fprintf(stderr, "disk_cache: the result went into no slot.\n");
+		libcda_disk_cache_close(cache);
+		return 1;
+	}
+
+	leave_odd(slot, getpid(), now_milliseconds());
+	failures += check("a slot being written", cache, NULL);
+	store_url(cache, "https://example.com/second.mp4");
+	failures += check("a store into a slot being written", cache, NULL);
+
+	leave_odd(slot, getpid(), now_milliseconds() - 2 * DISK_CACHE_STALE_WRITE);
+	store_url(cache, "https://example.com/third.mp4");
+	failures += check("a store into a slot of a hanging writer", cache, "https://example.com/third.mp4");
+
+	leave_odd(slot, dead_pid(), now_milliseconds());
+	store_url(cache, "https://example.com/fourth.mp4");
+	failures += check("a store into a slot of a dead writer", cache, "https://example.com/fourth.mp4");
+
+	libcda_disk_cache_close(cache);
+	printf("disk_cache: %d failed\n", failures);
+	return failures != 0;
+}
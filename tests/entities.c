@@ -0,0 +1,81 @@
+// SPDX-License-Identifier: LicenseRef-Dual-LGPLv3-OR-CC-BY-ND-For-Rust
+/* The fast player_data extraction against libxml2, the reference it has to
+ * match, on character references around the edges of what HTML allows. The
+ * fast path may give up on a value, leaving it to libxml2, but must never
+ * decode it differently. */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "libcda.h"
+#include "../src/get_url_internal.h"
+
+struct entity_case {
+	const char * value;
+	int fast;
+};
+
+static const struct entity_case cases[] = {
+	{"A&#65;B", 1},
+	{"A&#x41;B", 1},
+	{"A&#X41;B", 1},
+	{"&quot;&amp;&lt;&gt;&apos;", 1},
+	{"A&# 65;B", 0},
+	{"A&#+65;B", 0},
+	{"A&#-65;B", 0},
+	{"A&#x 41;B", 0},
+	{"A&#x+41;B", 0},
+	{"A&#x-41;B", 0},
+	{"A&#\t65;B", 0},
+	{"A&#;B", 0},
+	{"A&#x;B", 0}
+};
+
+static int check_case(const struct entity_case * entity) {
+	struct player_data_scanner scanner = {0};
+	struct known_size_memory_region whole_page;
+	char * player_id = get_player_id("test00");
+	char * fast = NULL;
+	char * reference = NULL;
+	char page[512];
+	int failed = 0;
+
+	snprintf(page, sizeof(page), "<html><body><div id=\"mediaplayertest00\" player_data=\"%s\"></div></body></html>", entity->value);
+	whole_page.memory = page;
+	whole_page.size = strlen(page);
+	scanner.needle = player_id;
+	scanner.needle_length = strlen(player_id);
+	if(scan_for_player_data(&scanner, &whole_page)) fast = extract_raw_json_fast(page, &scanner);
+	reference = extract_raw_json_with_libxml2("test00", page, whole_page.size);
+
+	if(reference == NULL) {
+		fprintf(stderr, "entities: libxml2 found nothing in %s.\n", entity->value);
+		failed = 1;
+	} else if(fast != NULL && strcmp(fast, reference)) {
+		fprintf(stderr, "entities: %s decodes to \"%s\", libxml2 says \"%s\".\n", entity->value, fast, reference);
+		failed = 1;
+	} else if((fast != NULL) != entity->fast) {
+		fprintf(stderr, "entities: %s %s the fast path.\n", entity->value, fast != NULL ? "unexpectedly took" : "missed");
+		failed = 1;
+	}
+	free(fast);
+	fast = entity->fast ? NULL : decode_html_entities(entity->value, strlen(entity->value));
+	if(fast != NULL) {
+		fprintf(stderr, "entities: decode_html_entities took %s.\n", entity->value);
+		failed = 1;
+	}
+	free(fast);
+	free(reference);
+	free(player_id);
+	return failed;
+}
+
+int main(void) {
+	size_t counter = 0;
+	int failures = 0;
+	if(libcda_global_init()) return 1;
+	for(counter = 0; counter < sizeof(cases) / sizeof(cases[0]); ++counter) failures += check_case(cases + counter);
+	libcda_global_cleanup();
+	printf("entities: %zu cases, %d failed\n", sizeof(cases) / sizeof(cases[0]), failures);
+	return failures != 0;
+}
@@ -0,0 +1,70 @@
+// SPDX-License-Identifier: LicenseRef-Dual-LGPLv3-OR-CC-BY-ND-For-Rust
+/* LIBCDA_OPT_HTTP2 both ways against an HTTPS server that speaks both
+ * HTTP/1.1 and HTTP/2, given in LIBCDA_TEST_HTTPS_URL, as in
+ *	nghttpx -f'127.0.0.1,8443' -b'127.0.0.1,8080' key.pem cert.pem &
+ *	LIBCDA_TEST_HTTPS_URL=https://127.0.0.1:8443/ make test
+ * Curl would go for HTTP/2 over TLS on its own, so with the option off the
+ * transfer has to stay on HTTP/1.1. Without a server there is nothing to
+ * ask and the test is skipped. */
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "libcda.h"
+#include "../src/get_url_internal.h"
+
+static size_t discard_page(char * data, size_t size, size_t nmemb, void * userdata) {
+	(void)data;
+	(void)userdata;
+	return size * nmemb;
+}
+
+static int check_version(const char * url, const long http2, const long expected) {
+	struct libcda_session * session = libcda_session_create();
+	CURL * curl = NULL;
+	CURLcode response = CURLE_OK;
+	long version = 0;
+	int failed = 0;
+
+	if(session == NULL || libcda_session_setopt(session, LIBCDA_OPT_HTTP2, http2)) {
+		libcda_session_destroy(session);
+		return 1;
+	}
+	curl = acquire_curl_handle(session, url, discard_page, NULL);
+	if(curl == NULL) {
+		libcda_session_destroy(session);
+		return 1;
+	}
+	/* The test server has a certificate of its own making */
+	curl_easy_setopt(curl, CURLOPT_SSL_VERIFYPEER, 0L);
+	curl_easy_setopt(curl, CURLOPT_SSL_VERIFYHOST, 0L);
+	response = curl_easy_perform(curl);
+	if(response != CURLE_OK) {
+		fprintf(stderr, "http_version: %s failed: %s\n", url, curl_easy_strerror(response));
+		failed = 1;
+	} else {
+		curl_easy_getinfo(curl, CURLINFO_HTTP_VERSION, &version);
+		if(version != expected) {
+			fprintf(stderr, "http_version: with LIBCDA_OPT_HTTP2 %ld curl spoke version %ld, not %ld.\n", http2, version, expected);
+			failed = 1;
+		}
+	}
+	release_curl_handle(session, curl);
+	libcda_session_destroy(session);
+	return failed;
+}
+
+int main(void) {
+	const char * url = getenv("LIBCDA_TEST_HTTPS_URL");
+	int failures = 0;
+	if(url == NULL || !*url) {
+		printf("http_version: skipped, LIBCDA_TEST_HTTPS_URL is not set\n");
+		return 0;
+	}
+	if(libcda_global_init()) return 1;
+	failures += check_version(url, 0L, CURL_HTTP_VERSION_1_1);
+	if(curl_version_info(CURLVERSION_NOW)->features & CURL_VERSION_HTTP2) failures += check_version(url, 1L, CURL_HTTP_VERSION_2_0);
+	else printf("http_version: curl has no HTTP/2, only checked HTTP/1.1\n");
+	libcda_global_cleanup();
+	printf("http_version: %d failed\n", failures);
+	return failures != 0;
+}
@@ -0,0 +1,114 @@
+// SPDX-License-Identifier: LicenseRef-Dual-LGPLv3-OR-CC-BY-ND-For-Rust
+/* libcda_parse_* on a video of bench/corpus, which has pages of its own
+ * for the qualities besides the one its first page plays. Until those are
+ * in, the result is partial and still has to serialize. Run from the top
+ * of the tree, as make test does. */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "libcda.h"
+
+#define PARSE_CORPUS	"bench/corpus"
+#define PARSE_VIDEO	"filea1"
+#define PARSE_MISSING_MAX	8
+
+static char * read_page(const char * page_url, size_t * length) {
+	const char * quality = strstr(page_url, "?wersja=");
+	char path[256];
+	char * result = NULL;
+	long size = 0;
+	FILE * file = NULL;
+	if(quality != NULL) snprintf(path, sizeof(path), "%s/%s_%s.html", PARSE_CORPUS, PARSE_VIDEO, quality + 8);
+	else snprintf(path, sizeof(path), "%s/%s.html", PARSE_CORPUS, PARSE_VIDEO);
+	file = fopen(path, "rb");
+	if(file == NULL || fseek(file, 0, SEEK_END) || (size = ftell(file)) < 0 || fseek(file, 0, SEEK_SET)) {
+		fprintf(stderr, "parse: could not read %s.\n", path);
+		if(file != NULL) fclose(file);
+		return NULL;
+	}
+	result = malloc(size ? size : 1);
+	if(result != NULL && fread(result, 1, size, file) != (size_t)size) {
+		free(result);
+		result = NULL;
+	}
+	fclose(file);
+	*length = size;
+	return result;
+}
+
+static int take_page(struct libcda_parse * parse, const char * page_url) {
+	size_t length = 0;
+	char * page = read_page(page_url, &length);
+	int status = page != NULL ? libcda_parse_page(parse, page_url, page, length) : LIBCDA_STATUS_DOWNLOAD_FAILED;
+	free(page);
+	return status;
+}
+
+/* The result as it is now must come with expected_status, have
+ * expected_missing URLs NULL and serialize with as many nulls. */
+static int check_results(struct libcda_parse * parse, const int expected_status, const size_t expected_missing) {
+	struct cda_results * result = NULL;
+	char * json = NULL;
+	char * null = NULL;
+	size_t missing = 0;
+	size_t nulls = 0;
+	size_t counter = 0;
+	int status = -1;
+	int failed = 0;
+	result = libcda_parse_results(parse, &status);
+	if(result == NULL) {
+		fprintf(stderr, "parse: no result, status %d.\n", status);
+		return 1;
+	}
+	for(counter = 0; counter < result->url_count; ++counter) missing += result->url[counter] == NULL;
+	json = libcda_results_json(result);
+	for(null = json; null != NULL && (null = strstr(null, "null")) != NULL; null += 4) ++nulls;
+	if(status != expected_status || missing != expected_missing || json == NULL || nulls != expected_missing) {
+		fprintf(stderr, "parse: status %d with %zu URLs missing, %zu null in %s; wanted status %d and %zu.\n", status, missing, nulls, json != NULL ? json : "no JSON", expected_status, expected_missing);
+		failed = 1;
+	}
+	free(json);
+	libcda_free_get_url(result);
+	return failed;
+}
+
+int main(void) {
+	struct libcda_parse * parse = NULL;
+	const char * missing_urls[PARSE_MISSING_MAX];
+	char * page_urls[PARSE_MISSING_MAX];
+	size_t missing = 0;
+	size_t counter = 0;
+	int failures = 0;
+	if(libcda_global_init()) return 1;
+	parse = libcda_parse_create("https://www.cda.pl/video/" PARSE_VIDEO);
+	if(parse == NULL || take_page(parse, "https://www.cda.pl/video/" PARSE_VIDEO) != LIBCDA_STATUS_OK) {
+		fprintf(stderr, "parse: the first page of %s did not parse.\n", PARSE_VIDEO);
+		libcda_parse_destroy(parse);
+		libcda_global_cleanup();
+		return 1;
+	}
+	missing = libcda_parse_missing_urls(parse, missing_urls, PARSE_MISSING_MAX);
+	if(!missing || missing > PARSE_MISSING_MAX) {
+		fprintf(stderr, "parse: %zu pages missing after the first one.\n", missing);
+		++failures;
+		missing = 0;
+	} else {
+		failures += check_results(parse, LIBCDA_STATUS_PARTIAL, missing);
+	}
+/* Taking a page frees its URL */
+	for(counter = 0; counter < missing; ++counter) page_urls[counter] = strdup(missing_urls[counter]);
+	for(counter = 0; counter < missing; ++counter) {
+		if(page_urls[counter] == NULL || take_page(parse, page_urls[counter]) != LIBCDA_STATUS_OK) {
+			fprintf(stderr, "parse: %s did not parse.\n", page_urls[counter] != NULL ? page_urls[counter] : "a page");
+			++failures;
+		} else {
+			failures += check_results(parse, counter + 1 < missing ? LIBCDA_STATUS_PARTIAL : LIBCDA_STATUS_OK, missing - counter - 1);
+		}
+		free(page_urls[counter]);
+	}
+	libcda_parse_destroy(parse);
+	libcda_global_cleanup();
+	printf("parse: %zu pages, %d failed\n", missing + 1, failures);
+	return failures != 0;
+}
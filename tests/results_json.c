@@ -0,0 +1,45 @@
+// SPDX-License-Identifier: LicenseRef-Dual-LGPLv3-OR-CC-BY-ND-For-Rust
+/* libcda_results_json on results whose url entries are missing, as lazy and
+ * partial results have them, which come out as null. */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "libcda.h"
+
+struct json_case {
+	char * qualities[3];
+	char * urls[3];
+	size_t quality_count;
+	size_t url_count;
+	char json_type;
+	const char * expected;
+};
+
+static const struct json_case cases[] = {
+	{{"480p", "720p"}, {"https://example.com/480.mp4", "https://example.com/720.mp4"}, 2, 2, LIBCDA_VIDEO_IS_FILE,
+		"{\"json_type\":\"file\",\"qualities\":[\"480p\",\"720p\"],\"urls\":[\"https://example.com/480.mp4\",\"https://example.com/720.mp4\"]}"},
+	{{"480p", "720p", "1080p"}, {"https://example.com/480.mp4", NULL, "https://example.com/1080.mp4"}, 3, 3, LIBCDA_VIDEO_IS_FILE,
+		"{\"json_type\":\"file\",\"qualities\":[\"480p\",\"720p\",\"1080p\"],\"urls\":[\"https://example.com/480.mp4\",null,\"https://example.com/1080.mp4\"]}"},
+	{{"480p", "720p"}, {NULL, NULL}, 2, 2, LIBCDA_VIDEO_IS_FILE,
+		"{\"json_type\":\"file\",\"qualities\":[\"480p\",\"720p\"],\"urls\":[null,null]}"},
+	{{"auto"}, {NULL}, 1, 1, LIBCDA_VIDEO_IS_M3U8,
+		"{\"json_type\":\"m3u8\",\"qualities\":[\"auto\"],\"urls\":[null]}"}
+};
+
+static int check_case(const struct json_case * json) {
+	struct cda_results results = {(char **)json->qualities, (char **)json->urls, json->quality_count, json->url_count, json->json_type, NULL};
+	char * got = libcda_results_json(&results);
+	int failed = got == NULL || strcmp(got, json->expected);
+	if(failed) fprintf(stderr, "results_json: got %s, wanted %s.\n", got != NULL ? got : "nothing", json->expected);
+	free(got);
+	return failed;
+}
+
+int main(void) {
+	size_t counter = 0;
+	int failures = 0;
+	for(counter = 0; counter < sizeof(cases) / sizeof(cases[0]); ++counter) failures += check_case(cases + counter);
+	printf("results_json: %zu cases, %d failed\n", sizeof(cases) / sizeof(cases[0]), failures);
+	return failures != 0;
+}